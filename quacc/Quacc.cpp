@@ -43,43 +43,188 @@ inline int getShotCountOption(const xacc::HeterogeneousMap &in_options) {
   }
   return result;
 }
+
+// True if no instruction acts on a qubit after it has been measured,
+// i.e. all the measurements can be performed at the very end of the kernel.
+inline bool hasOnlyTerminalMeasurements(const std::shared_ptr<xacc::CompositeInstruction> &in_kernel) {
+  std::set<size_t> measuredBits;
+  InstructionIterator it(in_kernel);
+  while (it.hasNext()) {
+    auto nextInst = it.next();
+    if (!nextInst->isEnabled() || nextInst->isComposite()) {
+      continue;
+    }
+    for (const auto &bit : nextInst->bits()) {
+      if (measuredBits.count(bit)) {
+        return false;
+      }
+    }
+    if (nextInst->name() == "Measure") {
+      measuredBits.insert(nextInst->bits()[0]);
+    }
+  }
+  return true;
+}
+
+// The instructions of in_kernel its measurements depend on, all of them terminal: walking the kernel backwards,
+// an instruction is kept if it acts on a qubit of the backward light cone of the measured qubits, all of its
+// qubits then joining the cone. The others only act on qubits that never interact with the cone afterwards.
+inline std::shared_ptr<xacc::CompositeInstruction> lightCone(const std::shared_ptr<xacc::CompositeInstruction> &in_kernel) {
+  std::vector<xacc::InstPtr> instructions;
+  std::set<size_t> cone;
+  InstructionIterator it(in_kernel);
+  while (it.hasNext()) {
+    auto nextInst = it.next();
+    if (!nextInst->isEnabled() || nextInst->isComposite()) {
+      continue;
+    }
+    instructions.push_back(nextInst);
+    if (nextInst->name() == "Measure") {
+      cone.insert(nextInst->bits()[0]);
+    }
+  }
+
+  std::vector<xacc::InstPtr> kept;
+  for (auto inst = instructions.rbegin(); inst != instructions.rend(); ++inst) {
+    const auto bits = (*inst)->bits();
+    if (std::none_of(bits.begin(), bits.end(), [&](size_t in_bit) { return cone.count(in_bit) > 0; })) {
+      continue;
+    }
+    cone.insert(bits.begin(), bits.end());
+    kept.push_back(*inst);
+  }
+
+  if (cone.empty() || kept.size() == instructions.size()) {
+    return in_kernel;
+  }
+
+  auto pruned = xacc::getIRProvider("quantum")->createComposite(in_kernel->name(), in_kernel->getVariables());
+  pruned->addInstructions(std::vector<xacc::InstPtr>(kept.rbegin(), kept.rend()));
+  return pruned;
+}
+
+// Qubits in_kernel measures
+inline std::set<size_t> measuredQubits(const std::shared_ptr<xacc::CompositeInstruction> &in_kernel) {
+  std::set<size_t> qubits;
+  InstructionIterator it(in_kernel);
+  while (it.hasNext()) {
+    auto nextInst = it.next();
+    if (nextInst->isEnabled() && !nextInst->isComposite() && nextInst->name() == "Measure") {
+      qubits.insert(nextInst->bits()[0]);
+    }
+  }
+  return qubits;
+}
+
+// Qubits in_kernel acts on, in increasing order
+inline std::vector<size_t> activeQubits(const std::shared_ptr<xacc::CompositeInstruction> &in_kernel) {
+  std::set<size_t> qubits;
+  InstructionIterator it(in_kernel);
+  while (it.hasNext()) {
+    auto nextInst = it.next();
+    if (nextInst->isEnabled() && !nextInst->isComposite()) {
+      const auto bits = nextInst->bits();
+      qubits.insert(bits.begin(), bits.end());
+    }
+  }
+  return std::vector<size_t>(qubits.begin(), qubits.end());
+}
+
+inline bool usesGlobalQreg() {
+  return xacc::optionExists("use_global_qreg") && xacc::getOption("use_global_qreg") == "true";
+}
 } // namespace
 namespace quacc {
 
 	const std::string Quacc::DEFAULT_VISITOR_BACKEND = "quest-default";
 
+	std::shared_ptr<xacc::CompositeInstruction> Quacc::restrictKernel(std::shared_ptr<AcceleratorBuffer> buffer,
+										  const std::shared_ptr<xacc::CompositeInstruction> kernel,
+										  bool terminalMeasurements) {
+	  // The state of the global register outlives the kernel, all of its gates must be applied on all of its qubits
+	  if (usesGlobalQreg()) {
+		return kernel;
+	  }
+
+	  const auto executed = lightConePruning && terminalMeasurements ? lightConeOf(kernel) : kernel;
+
+	  // The register is only allocated over the qubits the kernel acts on, the idle ones staying in |0>
+	  if (compactIdleQubits && visitor->supportActiveQubits()) {
+		const auto qubits = activeQubits(executed);
+		if (!qubits.empty() && qubits.size() < buffer->size()) {
+		  visitor->setActiveQubits(qubits);
+		}
+	  }
+	  return executed;
+	}
+
+	std::shared_ptr<xacc::CompositeInstruction> Quacc::lightConeOf(const std::shared_ptr<xacc::CompositeInstruction> &kernel) {
+	  auto measured = measuredQubits(kernel);
+	  const auto cached = lightCones.find(kernel.get());
+	  if (cached != lightCones.end() && cached->second.kernel.lock() == kernel &&
+		  cached->second.nbInstructions == kernel->nInstructions() && cached->second.measuredQubits == measured) {
+		return cached->second.pruned ? cached->second.pruned : kernel;
+	  }
+
+	  // The kernels that no longer exist are dropped first, their addresses may be reused
+	  for (auto entry = lightCones.begin(); entry != lightCones.end();) {
+		entry = entry->second.kernel.expired() ? lightCones.erase(entry) : std::next(entry);
+	  }
+
+	  const auto pruned = lightCone(kernel);
+	  lightCones[kernel.get()] = {kernel, kernel->nInstructions(), std::move(measured), pruned == kernel ? nullptr : pruned};
+	  return pruned;
+	}
+
 	void Quacc::execute(
 		std::shared_ptr<AcceleratorBuffer> buffer,
 		const std::vector<std::shared_ptr<xacc::CompositeInstruction>> functions) {
 	  visitor = xacc::getService<xQuaccVisitor>(getVisitorName())->clone();
+	  usedVisitors[visitor->name()] = visitor;
 	  // If in VQE mode and there are more than one kernels
 	  if (vqeMode && functions.size() > 1 && visitor->supportVqeMode()) {
 		auto kernelDecomposed = ObservedAnsatz::fromObservedComposites(functions);
 		// Always validate kernel decomposition in DEBUG
 		assert(kernelDecomposed.validate(functions));
 		visitor->setOptions(options);
+		visitor->setTerminalMeasurements(false);
+
+		// The ansatz and the observed sub-circuits are all simulated on the qubits any of them acts on
+		auto base = kernelDecomposed.getBase();
+		auto obsCircuits = kernelDecomposed.getObservedSubCircuits();
+		if (compactIdleQubits && visitor->supportActiveQubits() && !usesGlobalQreg()) {
+		  std::set<size_t> qubits;
+		  for (const auto &function : functions) {
+			const auto functionQubits = activeQubits(function);
+			qubits.insert(functionQubits.begin(), functionQubits.end());
+		  }
+		  if (!qubits.empty() && qubits.size() < buffer->size()) {
+			visitor->setActiveQubits(std::vector<size_t>(qubits.begin(), qubits.end()));
+		  }
+		}
 
 		// Initialize the visitor
 		visitor->initialize(buffer);
-		visitor->setKernelName(kernelDecomposed.getBase()->name());
+		visitor->setKernelName(base->name());
 
 		// Walk the base IR tree, and visit each node
-		InstructionIterator it(kernelDecomposed.getBase());
-		while (it.hasNext()) {
-		  auto nextInst = it.next();
-		  if (nextInst->isEnabled() && !nextInst->isComposite()) {
-			nextInst->accept(visitor);
+		if (!visitor->replayKernel(base)) {
+		  InstructionIterator it(base);
+		  while (it.hasNext()) {
+			auto nextInst = it.next();
+			if (nextInst->isEnabled() && !nextInst->isComposite()) {
+			  nextInst->accept(visitor);
+			}
 		  }
 		}
 
 		// Now we have a wavefunction that represents execution of the ansatz.
 		// Run the observable sub-circuits (change of basis + measurements)
-		auto obsCircuits = kernelDecomposed.getObservedSubCircuits();
+		const auto expectationValues = visitor->getExpectationValuesZ(obsCircuits);
 		for (int i = 0; i < obsCircuits.size(); ++i) {
 		  auto tmpBuffer = std::make_shared<xacc::AcceleratorBuffer>(
 			  obsCircuits[i]->name(), buffer->size());
-		  double e = visitor->getExpectationValueZ(obsCircuits[i]);
-		  tmpBuffer->addExtraInfo("exp-val-z", e);
+		  tmpBuffer->addExtraInfo("exp-val-z", expectationValues[i]);
 		  buffer->appendChild(obsCircuits[i]->name(), tmpBuffer);
 		}
 		// Finalize the visitor
@@ -98,22 +243,38 @@ namespace quacc {
 	  return;
 	}
 
+	void Quacc::checkShots(const std::shared_ptr<xacc::CompositeInstruction> kernel, bool terminalMeasurements) const {
+	  if (nbShots > 1 && !(visitor->supportShotSampling() && terminalMeasurements)) {
+		xacc::error("Quacc: " + std::to_string(nbShots) + " shots requested of kernel " + kernel->name() + ", but the " +
+					visitor->name() + " visitor can only sample shots from kernels whose measurements all come last.");
+	  }
+	}
+
 	void Quacc::execute(std::shared_ptr<xacc::AcceleratorBuffer> buffer,
 						const std::shared_ptr<xacc::CompositeInstruction> kernel) {
 	  // Get the visitor backend
 	  visitor = xacc::getService<xQuaccVisitor>(getVisitorName());
+	  usedVisitors[visitor->name()] = visitor;
 	  visitor->setOptions(options);
+	  // With only terminal measurements, the visitor reads all of them out of the final state at once,
+	  // or draws all the requested shots from it.
+	  const bool terminal = hasOnlyTerminalMeasurements(kernel);
+	  checkShots(kernel, terminal);
+	  visitor->setTerminalMeasurements(visitor->supportShotSampling() && terminal);
+	  const auto executed = restrictKernel(buffer, kernel, terminal);
 
 	  // Initialize the visitor
 	  visitor->initialize(buffer);
 	  visitor->setKernelName(kernel->name());
 
-	  // Walk the IR tree, and visit each node
-	  InstructionIterator it(kernel);
-	  while (it.hasNext()) {
-		auto nextInst = it.next();
-		if (nextInst->isEnabled()) {
-		  nextInst->accept(visitor);
+	  // Walk the IR tree, and visit each node, unless the visitor already compiled this kernel
+	  if (!visitor->replayKernel(executed)) {
+		InstructionIterator it(executed);
+		while (it.hasNext()) {
+		  auto nextInst = it.next();
+		  if (nextInst->isEnabled()) {
+			nextInst->accept(visitor);
+		  }
 		}
 	  }
 
@@ -121,4 +282,74 @@ namespace quacc {
 	  visitor->finalize();
 	}
 
+	void Quacc::execute(std::shared_ptr<xacc::AcceleratorBuffer> buffer,
+						const std::shared_ptr<xacc::CompositeInstruction> kernel,
+						const std::vector<double>& parameters) {
+	  if (parameters.size() != kernel->getVariables().size()) {
+		xacc::error("Quacc: kernel " + kernel->name() + " has " +
+					std::to_string(kernel->getVariables().size()) + " variables, " +
+					std::to_string(parameters.size()) + " parameters given.");
+	  }
+
+	  visitor = xacc::getService<xQuaccVisitor>(getVisitorName());
+	  usedVisitors[visitor->name()] = visitor;
+	  visitor->setOptions(options);
+	  const bool terminal = hasOnlyTerminalMeasurements(kernel);
+	  checkShots(kernel, terminal);
+	  visitor->setTerminalMeasurements(visitor->supportShotSampling() && terminal);
+	  const auto executed = restrictKernel(buffer, kernel, terminal);
+
+	  visitor->initialize(buffer);
+	  visitor->setKernelName(kernel->name());
+
+	  // Fall back to evaluating the kernel if the visitor cannot bind its parameters
+	  if (!visitor->bindParameters(executed, parameters)) {
+		auto evaluated = (*executed)(parameters);
+		if (!visitor->replayKernel(evaluated)) {
+		  InstructionIterator it(evaluated);
+		  while (it.hasNext()) {
+			auto nextInst = it.next();
+			if (nextInst->isEnabled()) {
+			  nextInst->accept(visitor);
+			}
+		  }
+		}
+	  }
+
+	  visitor->finalize();
+	}
+
+	void Quacc::computeGradient(std::shared_ptr<xacc::AcceleratorBuffer> buffer,
+								const std::shared_ptr<xacc::CompositeInstruction> kernel,
+								const std::vector<double>& parameters,
+								std::shared_ptr<xacc::Observable> observable) {
+	  if (parameters.size() != kernel->getVariables().size()) {
+		xacc::error("Quacc: kernel " + kernel->name() + " has " +
+					std::to_string(kernel->getVariables().size()) + " variables, " +
+					std::to_string(parameters.size()) + " parameters given.");
+	  }
+
+	  visitor = xacc::getService<xQuaccVisitor>(getVisitorName());
+	  usedVisitors[visitor->name()] = visitor;
+	  visitor->setOptions(options);
+	  visitor->setTerminalMeasurements(false);
+
+	  visitor->initialize(buffer);
+	  visitor->setKernelName(kernel->name());
+
+	  std::vector<double> gradient;
+	  double value;
+	  const bool computed = visitor->computeGradient(kernel, parameters, observable, gradient, value);
+
+	  visitor->finalize();
+
+	  if (!computed) {
+		xacc::error("Quacc: the " + visitor->name() + " visitor cannot compute the gradient of kernel " + kernel->name() +
+					" (parameters must be affine in its variables, observable a Pauli operator, and no measurement).");
+	  }
+
+	  buffer->addExtraInfo("gradient", gradient);
+	  buffer->addExtraInfo("exp-val", value);
+	}
+
 } // namespace quacc
@@ -38,6 +38,8 @@
 #include "xacc.hpp"
 #include "xacc_service.hpp"
 #include <cassert>
+#include <map>
+#include <set>
 
 #include "QuEST.h"
 #include "visitors/QuaccVisitor.hpp"
@@ -64,6 +66,13 @@ namespace quacc {
 
 		// Clear the cached configs on XaccQuest initialize.
 		options.clear();
+		// The accelerator is a single shared service: the settings of a previous configuration must not
+		// leak into this one, only those given in params apply.
+		vqeMode = true;
+		lightConePruning = false;
+		compactIdleQubits = true;
+		nbShots = -1;
+		backendName = DEFAULT_VISITOR_BACKEND;
 		// Force a configuration update,
 		// which will update the cache appropriately.
 		updateConfiguration(params);
@@ -93,6 +102,12 @@ namespace quacc {
 		if (config.keyExists<bool>("vqe-mode")) {
 		  vqeMode = config.get<bool>("vqe-mode");
 		}
+		if (config.keyExists<bool>("light-cone")) {
+		  lightConePruning = config.get<bool>("light-cone");
+		}
+		if (config.keyExists<bool>("idle-qubit-compaction")) {
+		  compactIdleQubits = config.get<bool>("idle-qubit-compaction");
+		}
 
 		if (config.stringExists("quacc-visitor") ||
 			config.stringExists("backend")) {
@@ -152,6 +167,23 @@ namespace quacc {
 				   const std::vector<std::shared_ptr<CompositeInstruction>>
 					   functions) override;
 
+	  // Executes the parameterized kernel with its variables set to parameters.
+	  // The kernel is compiled on its first execution, following executions only
+	  // update the gates depending on the variables: no IR is built nor walked.
+	  void execute(std::shared_ptr<AcceleratorBuffer> buffer,
+				   const std::shared_ptr<xacc::CompositeInstruction> kernel,
+				   const std::vector<double>& parameters);
+
+	  // Gradient of the expectation value of observable in the state prepared by kernel,
+	  // with respect to the kernel variables at parameters. All the shifted circuits of the
+	  // parameter-shift rule are simulated concurrently, on registers of their own, unless
+	  // the gradient-method option is "adjoint": one backward sweep over the gates then.
+	  // The gradient is stored in buffer as "gradient", the expectation value as "exp-val".
+	  void computeGradient(std::shared_ptr<AcceleratorBuffer> buffer,
+						   const std::shared_ptr<xacc::CompositeInstruction> kernel,
+						   const std::vector<double>& parameters,
+						   std::shared_ptr<xacc::Observable> observable);
+
 	  const std::string name() const override { return "quest"; }
 
 	  const std::string description() const override {
@@ -175,6 +207,9 @@ namespace quacc {
 
 		  }
 
+		  for (auto &used : usedVisitors)
+			  used.second->releaseResources();
+
 		  destroyQuESTEnv(env);
 
 	  }
@@ -193,6 +228,9 @@ namespace quacc {
 
 	protected:
 	  std::shared_ptr<xQuaccVisitor> visitor;
+	  // Last visitor of each backend run by this accelerator, whose resources are
+	  // released before env is destroyed.
+	  std::map<std::string, std::shared_ptr<xQuaccVisitor>> usedVisitors;
 
 	private:
 
@@ -203,6 +241,21 @@ namespace quacc {
 	  int __verbose = 1;
 	  bool executedOnce = false;
 	  bool vqeMode = true;
+	  // Kernels whose measurements are all terminal are reduced to the backward light cone of the measured qubits
+	  // (option "light-cone"). The VQE path, whose observed sub-circuits measure the ansatz state, is never pruned.
+	  bool lightConePruning = false;
+	  // Light cone of each kernel executed with pruning on, reused as long as the kernel is alive, unchanged in size
+	  // and measures the same qubits, so that re-executing it (e.g. binding new parameters) does not rebuild it.
+	  struct LightCone {
+		std::weak_ptr<xacc::CompositeInstruction> kernel;
+		size_t nbInstructions;
+		std::set<size_t> measuredQubits;
+		// Null when the light cone is the whole kernel
+		std::shared_ptr<xacc::CompositeInstruction> pruned;
+	  };
+	  std::map<const xacc::CompositeInstruction*, LightCone> lightCones;
+	  // Kernels are simulated on a register of the qubits they act on only, see xQuaccVisitor::setActiveQubits()
+	  bool compactIdleQubits = true;
 
 	  static const std::string DEFAULT_VISITOR_BACKEND;
 	  // The backend name that is configured.
@@ -212,10 +265,22 @@ namespace quacc {
 	  // If not specified (i.e. left as -1),
 	  // then we don't return the binary measurement result (as a bit string).
 	  // This is to make sure that on the XACC side, it can interpret the avarage-Z result correctly.
+	  // The shots are all drawn from a single simulation of the kernel, see checkShots().
 	  int nbShots = -1;
 	  // Cache of the QUACC options (to send on to the visitor)
 	  HeterogeneousMap options;
 
+	  // The kernel the visitor executes for kernel, e.g. its light cone. The visitor is given the qubits
+	  // it acts on as active ones if it leaves some of those of buffer idle.
+	  std::shared_ptr<xacc::CompositeInstruction> restrictKernel(std::shared_ptr<AcceleratorBuffer> buffer,
+																 const std::shared_ptr<xacc::CompositeInstruction> kernel,
+																 bool terminalMeasurements);
+	  // Raises an error if more than one shot is requested of a kernel the visitor cannot sample them from,
+	  // i.e. one measuring a qubit before other gates act on it, as every shot would then need a run of its own.
+	  void checkShots(const std::shared_ptr<xacc::CompositeInstruction> kernel, bool terminalMeasurements) const;
+	  // The light cone of kernel, from lightCones if it was already pruned
+	  std::shared_ptr<xacc::CompositeInstruction> lightConeOf(const std::shared_ptr<xacc::CompositeInstruction> &kernel);
+
 	};
 } // namespace quacc
 
@@ -67,13 +67,52 @@ namespace quacc {
 		  virtual void initialize(std::shared_ptr<AcceleratorBuffer> buffer) = 0;
 		  virtual const double
 		  getExpectationValueZ(std::shared_ptr<CompositeInstruction> function) = 0;
+		  // Expectation values of several observed sub-circuits against the same state.
+		  // Visitor implementations may override this to share work between the terms.
+		  virtual std::vector<double>
+		  getExpectationValuesZ(const std::vector<std::shared_ptr<CompositeInstruction>>& functions) {
+			std::vector<double> result;
+			for (const auto& function : functions)
+			  result.push_back(getExpectationValueZ(function));
+			return result;
+		  }
+
+		  // Executes kernel from a previously compiled form, if the visitor has one, instead of
+		  // having the accelerator walk its IR. Returns false if the kernel still has to be visited.
+		  virtual bool replayKernel(std::shared_ptr<CompositeInstruction> kernel) { return false; }
+		  // Executes kernel, whose gates depend on its variables, with the variables set to parameters,
+		  // without evaluating the kernel into a new IR tree. Returns false if the visitor cannot,
+		  // in which case the accelerator visits the evaluated kernel instead.
+		  virtual bool bindParameters(std::shared_ptr<CompositeInstruction> kernel, const std::vector<double>& parameters) { return false; }
+		  // Gradient of the expectation value of observable in the state prepared by kernel, with respect to
+		  // the kernel variables at parameters, along with the expectation value itself.
+		  // Returns false if the visitor cannot compute it.
+		  virtual bool computeGradient(std::shared_ptr<CompositeInstruction> kernel, const std::vector<double>& parameters,
+									   std::shared_ptr<Observable> observable, std::vector<double>& gradient, double& value) { return false; }
 
 		  virtual void finalize() = 0;
+		  // Frees what the visitor keeps between executions for the accelerator's QuESTEnv,
+		  // called by the accelerator before it destroys that env.
+		  virtual void releaseResources() {}
 		  void setOptions(const HeterogeneousMap& in_options) { options = in_options; }
 		  virtual void setKernelName(const std::string& in_kernelName) {}
 		  // Does this visitor implementation support VQE mode execution?
 		  // i.e. ability to cache the state vector after simulating the ansatz.
 		  virtual bool supportVqeMode() const { return false; }
+		  // Does this visitor implementation support deferred measurements?
+		  // i.e. ability to perform all terminal measurements at once, or to draw
+		  // all the shots from a single simulation of the kernel.
+		  virtual bool supportShotSampling() const { return false; }
+		  // Set by the accelerator when no gate follows a Measure in the kernel,
+		  // i.e. the measurements may be deferred until finalize().
+		  void setTerminalMeasurements(bool in_terminal) { terminalMeasurements = in_terminal; }
+		  // Can this visitor simulate a kernel on a register of its active qubits alone (see setActiveQubits())?
+		  virtual bool supportActiveQubits() const { return false; }
+		  // Set by the accelerator before initialize() when the next kernel only acts on in_qubits of the buffer,
+		  // in increasing order, the other ones staying in |0>. The kernel keeps the buffer numbering: the visitor
+		  // maps qubit in_qubits[q] to qubit q of its register. Measurements and the state are still reported on
+		  // the buffer qubits.
+		  void setActiveQubits(const std::vector<size_t>& in_qubits) { activeQubits = in_qubits; }
 		  // Execution information that visitor wants to persist.
 		  HeterogeneousMap getExecutionInfo() const { return executionInfo; }
 
@@ -83,6 +122,9 @@ namespace quacc {
 		  HeterogeneousMap options;
 		  // Visitor impl to set if need be.
 		  HeterogeneousMap executionInfo;
+		  bool terminalMeasurements = false;
+		  // Empty when the kernel acts on the qubits of the buffer themselves
+		  std::vector<size_t> activeQubits;
 	};
 
 } // namespace quacc
@@ -0,0 +1,64 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+
+#ifndef QUACC_NATIVE_KERNEL_TABLE_HPP_
+#define QUACC_NATIVE_KERNEL_TABLE_HPP_
+
+#include <cstdint>
+
+#include "NativeStateVector.hpp"
+
+namespace quacc {
+namespace native {
+
+	// The gate kernels compiled for one instruction set, see NativeKernels.hpp for their meaning.
+	struct KernelTable {
+		const char *simdPath;
+		void (*applyMatrix1)(StateVector&, int, const Amplitude*, uint64_t);
+		void (*applyDiagonal1)(StateVector&, int, Amplitude, Amplitude, uint64_t);
+		void (*applyX)(StateVector&, int, uint64_t);
+		void (*applySwap)(StateVector&, int, int);
+		void (*applyMatrix2)(StateVector&, int, int, const Amplitude*);
+		double (*calcProbabilityOfOne)(const StateVector&, int);
+		void (*collapse)(StateVector&, int, int, double);
+		double (*calcExpectationValueZ)(const StateVector&, uint64_t);
+	};
+
+	// Always built, for the baseline instruction set of the target
+	extern const KernelTable scalarKernels;
+	// Built when the compiler supports the instruction set, see QUACC_NATIVE_<ISA> in CMakeLists.txt
+	extern const KernelTable sse42Kernels;
+	extern const KernelTable avx2Kernels;
+	extern const KernelTable avx512Kernels;
+
+} // namespace native
+} // namespace quacc
+
+#endif /* QUACC_NATIVE_KERNEL_TABLE_HPP_ */
@@ -0,0 +1,135 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+
+#include <vector>
+
+#include "NativeKernels.hpp"
+#include "NativeKernelTable.hpp"
+
+namespace quacc {
+namespace native {
+
+	namespace {
+		// Kernel variants built into the library, from the widest instruction set down
+		std::vector<const KernelTable*> builtKernels() {
+			std::vector<const KernelTable*> kernels;
+#ifdef QUACC_NATIVE_AVX512
+			kernels.push_back(&avx512Kernels);
+#endif
+#ifdef QUACC_NATIVE_AVX2
+			kernels.push_back(&avx2Kernels);
+#endif
+#ifdef QUACC_NATIVE_SSE42
+			kernels.push_back(&sse42Kernels);
+#endif
+			kernels.push_back(&scalarKernels);
+			return kernels;
+		}
+
+		// Whether the CPU running the library has the instructions in_kernels were compiled for
+		bool isSupported(const KernelTable &in_kernels) {
+			const std::string path = in_kernels.simdPath;
+#if defined(__x86_64__) || defined(__i386__)
+			__builtin_cpu_init();
+			if (path == "avx512")
+				return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+			if (path == "avx2")
+				return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+			if (path == "sse4.2")
+				return __builtin_cpu_supports("sse4.2");
+#endif
+			return path == "scalar";
+		}
+
+		const KernelTable* bestKernels() {
+			for (const auto &kernels : builtKernels())
+				if (isSupported(*kernels))
+					return kernels;
+			return &scalarKernels;
+		}
+	}
+
+	Kernels::Kernels() : table(bestKernels()) {}
+
+	bool Kernels::select(const std::string &in_path) {
+
+		if (in_path == "auto") {
+			table = bestKernels();
+			return true;
+		}
+
+		for (const auto &kernels : builtKernels())
+			if (in_path == kernels->simdPath && isSupported(*kernels)) {
+				table = kernels;
+				return true;
+			}
+
+		return false;
+
+	}
+
+	const char* Kernels::simdPath() const {
+		return table->simdPath;
+	}
+
+	void Kernels::applyMatrix1(StateVector &io_state, int in_target, const Amplitude *in_matrix, uint64_t in_controlMask) const {
+		table->applyMatrix1(io_state, in_target, in_matrix, in_controlMask);
+	}
+
+	void Kernels::applyDiagonal1(StateVector &io_state, int in_target, Amplitude in_d0, Amplitude in_d1, uint64_t in_controlMask) const {
+		table->applyDiagonal1(io_state, in_target, in_d0, in_d1, in_controlMask);
+	}
+
+	void Kernels::applyX(StateVector &io_state, int in_target, uint64_t in_controlMask) const {
+		table->applyX(io_state, in_target, in_controlMask);
+	}
+
+	void Kernels::applySwap(StateVector &io_state, int in_qubit0, int in_qubit1) const {
+		table->applySwap(io_state, in_qubit0, in_qubit1);
+	}
+
+	void Kernels::applyMatrix2(StateVector &io_state, int in_qubit0, int in_qubit1, const Amplitude *in_matrix) const {
+		table->applyMatrix2(io_state, in_qubit0, in_qubit1, in_matrix);
+	}
+
+	double Kernels::calcProbabilityOfOne(const StateVector &in_state, int in_qubit) const {
+		return table->calcProbabilityOfOne(in_state, in_qubit);
+	}
+
+	void Kernels::collapse(StateVector &io_state, int in_qubit, int in_outcome, double in_probability) const {
+		table->collapse(io_state, in_qubit, in_outcome, in_probability);
+	}
+
+	double Kernels::calcExpectationValueZ(const StateVector &in_state, uint64_t in_zMask) const {
+		return table->calcExpectationValueZ(in_state, in_zMask);
+	}
+
+} // namespace native
+} // namespace quacc
@@ -0,0 +1,94 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+
+#ifndef QUACC_NATIVE_KERNELS_HPP_
+#define QUACC_NATIVE_KERNELS_HPP_
+
+#include <cstdint>
+#include <string>
+
+#include "NativeStateVector.hpp"
+
+namespace quacc {
+namespace native {
+
+	struct KernelTable;
+
+	// The gate kernels of one of the instruction set variants they are built for. Each visitor holds its own,
+	// so that selecting a variant does not change the kernels the other visitors run.
+	// Controlled kernels only act on the basis states having all the in_controlMask bits set (the target bits
+	// excluded). Matrices are row-major, and for two-qubit matrices in_qubit0 is the least significant bit of
+	// the matrix indices.
+	class Kernels {
+
+		public:
+
+		  // The widest variant the CPU supports
+		  Kernels();
+
+		  // Switches to the in_path variant: "avx512", "avx2", "sse4.2", "scalar", or "auto" for the widest one supported.
+		  // Returns false, keeping the current variant, if it is not built in or not supported by the CPU.
+		  bool select(const std::string &in_path);
+		  // Name of the variant in use
+		  const char* simdPath() const;
+
+		  // 2x2 in_matrix on in_target
+		  void applyMatrix1(StateVector &io_state, int in_target, const Amplitude *in_matrix, uint64_t in_controlMask = 0) const;
+
+		  // diag(in_d0, in_d1) on in_target
+		  void applyDiagonal1(StateVector &io_state, int in_target, Amplitude in_d0, Amplitude in_d1, uint64_t in_controlMask = 0) const;
+
+		  // Pauli X on in_target, i.e. X, CNOT, Toffoli... as a pure exchange of amplitudes.
+		  void applyX(StateVector &io_state, int in_target, uint64_t in_controlMask = 0) const;
+
+		  // Exchanges the in_qubit0 and in_qubit1 bits of the basis states.
+		  void applySwap(StateVector &io_state, int in_qubit0, int in_qubit1) const;
+
+		  // 4x4 in_matrix on in_qubit0 and in_qubit1
+		  void applyMatrix2(StateVector &io_state, int in_qubit0, int in_qubit1, const Amplitude *in_matrix) const;
+
+		  // Probability of measuring 1 on in_qubit
+		  double calcProbabilityOfOne(const StateVector &in_state, int in_qubit) const;
+
+		  // Projects in_qubit onto in_outcome, of probability in_probability, and renormalizes the state.
+		  void collapse(StateVector &io_state, int in_qubit, int in_outcome, double in_probability) const;
+
+		  // <psi|Z...Z|psi> over the in_zMask bits
+		  double calcExpectationValueZ(const StateVector &in_state, uint64_t in_zMask) const;
+
+		private:
+
+		  const KernelTable *table;
+	};
+
+} // namespace native
+} // namespace quacc
+
+#endif /* QUACC_NATIVE_KERNELS_HPP_ */
@@ -0,0 +1,348 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+
+// Gate kernels, compiled once per instruction set by the NativeKernels<ISA>.cpp files: each of them
+// defines QUACC_NATIVE_KERNELS, the name of the kernel table it exports, and includes this file.
+// The kernels themselves stay local to their translation unit. Out-of-line standard library templates
+// (std::vector, std::min...) are avoided in here: the linker keeps a single copy of them for all the
+// variants, which could then be one compiled for an instruction set the CPU lacks.
+
+#ifndef QUACC_NATIVE_KERNELS
+#error "QUACC_NATIVE_KERNELS must name the kernel table of the including file"
+#endif
+
+#include <cmath>
+
+#if defined(__AVX512F__) || defined(__AVX2__) || defined(__SSE4_2__)
+#include <immintrin.h>
+#endif
+
+#include "NativeKernelTable.hpp"
+
+namespace quacc {
+namespace native {
+
+	namespace {
+		// Number of contiguous chunks the reductions are split into.
+		// Fixed (i.e. independent of the thread count) so that the results are reproducible.
+		constexpr long long NB_BLOCKS = 1024;
+		// Passes over fewer amplitudes are not worth waking the threads up for
+		constexpr uint64_t MIN_PARALLEL_AMPS = 1ULL << 14;
+		// Longest run of contiguous amplitudes handed to a kernel, so that gates on the
+		// highest qubits still split into enough runs for every thread.
+		constexpr uint64_t MAX_RUN_LENGTH = 1ULL << 12;
+
+#if defined(__AVX512F__)
+#define QUACC_NATIVE_SIMD
+		constexpr const char* SIMD_PATH = "avx512";
+		// Amplitudes per vector register
+		constexpr uint64_t SIMD_WIDTH = 4;
+		typedef __m512d Vec;
+
+		inline Vec load(const Amplitude *in_ptr) { return _mm512_load_pd(reinterpret_cast<const double*>(in_ptr)); }
+		inline void store(Amplitude *out_ptr, Vec in_v) { _mm512_store_pd(reinterpret_cast<double*>(out_ptr), in_v); }
+		inline Vec broadcast(double in_x) { return _mm512_set1_pd(in_x); }
+		inline Vec add(Vec in_a, Vec in_b) { return _mm512_add_pd(in_a, in_b); }
+		// (in_re + i in_im) times each amplitude of in_x
+		inline Vec mul(Vec in_x, Vec in_re, Vec in_im) {
+			return _mm512_fmaddsub_pd(in_re, in_x, _mm512_mul_pd(in_im, _mm512_permute_pd(in_x, 0x55)));
+		}
+#elif defined(__AVX2__) && defined(__FMA__)
+#define QUACC_NATIVE_SIMD
+		constexpr const char* SIMD_PATH = "avx2";
+		constexpr uint64_t SIMD_WIDTH = 2;
+		typedef __m256d Vec;
+
+		inline Vec load(const Amplitude *in_ptr) { return _mm256_load_pd(reinterpret_cast<const double*>(in_ptr)); }
+		inline void store(Amplitude *out_ptr, Vec in_v) { _mm256_store_pd(reinterpret_cast<double*>(out_ptr), in_v); }
+		inline Vec broadcast(double in_x) { return _mm256_set1_pd(in_x); }
+		inline Vec add(Vec in_a, Vec in_b) { return _mm256_add_pd(in_a, in_b); }
+		inline Vec mul(Vec in_x, Vec in_re, Vec in_im) {
+			return _mm256_fmaddsub_pd(in_re, in_x, _mm256_mul_pd(in_im, _mm256_permute_pd(in_x, 0x5)));
+		}
+#elif defined(__SSE4_2__)
+#define QUACC_NATIVE_SIMD
+		constexpr const char* SIMD_PATH = "sse4.2";
+		constexpr uint64_t SIMD_WIDTH = 1;
+		typedef __m128d Vec;
+
+		inline Vec load(const Amplitude *in_ptr) { return _mm_load_pd(reinterpret_cast<const double*>(in_ptr)); }
+		inline void store(Amplitude *out_ptr, Vec in_v) { _mm_store_pd(reinterpret_cast<double*>(out_ptr), in_v); }
+		inline Vec broadcast(double in_x) { return _mm_set1_pd(in_x); }
+		inline Vec add(Vec in_a, Vec in_b) { return _mm_add_pd(in_a, in_b); }
+		inline Vec mul(Vec in_x, Vec in_re, Vec in_im) {
+			return _mm_addsub_pd(_mm_mul_pd(in_re, in_x), _mm_mul_pd(in_im, _mm_shuffle_pd(in_x, in_x, 1)));
+		}
+#else
+		constexpr const char* SIMD_PATH = "scalar";
+#endif
+
+		inline uint64_t minLength(uint64_t in_a, uint64_t in_b) { return in_a < in_b ? in_a : in_b; }
+
+		// Complex product without the NaN/inf handling of std::complex
+		inline Amplitude cmul(const Amplitude &in_a, const Amplitude &in_b) {
+			return {in_a.real() * in_b.real() - in_a.imag() * in_b.imag(),
+					in_a.real() * in_b.imag() + in_a.imag() * in_b.real()};
+		}
+
+		inline double probability(const Amplitude &in_a) {
+			return in_a.real() * in_a.real() + in_a.imag() * in_a.imag();
+		}
+
+		inline uint64_t insertZeroBit(uint64_t in_idx, int in_bit) {
+			const uint64_t low = in_idx & ((1ULL << in_bit) - 1);
+			return ((in_idx ^ low) << 1) | low;
+		}
+
+		// Calls in_run(p0, p1, length) over runs of contiguous amplitudes covering the pairs a gate on in_target
+		// mixes: the in_target bit is unset at p0, set at p1 = p0 + 2^in_target, and all the in_controlMask bits
+		// are set at both. Runs are aligned on their (power of two) length.
+		template <typename Run>
+		void forEachPairRun(StateVector &io_state, int in_target, uint64_t in_controlMask, Run in_run) {
+
+			const uint64_t stride = 1ULL << in_target;
+			const uint64_t lowControls = in_controlMask & (stride - 1);
+			// A control below the target cuts the runs down to the amplitudes having it set
+			const uint64_t length = minLength(lowControls ? lowControls & (~lowControls + 1) : stride, MAX_RUN_LENGTH);
+			const long long nbRuns = io_state.numAmps() / 2 / length;
+			Amplitude *amps = io_state.data();
+
+			#pragma omp parallel for schedule(static) if(io_state.numAmps() >= MIN_PARALLEL_AMPS)
+			for (long long r = 0; r < nbRuns; ++r) {
+				const uint64_t idx0 = insertZeroBit(r * length, in_target);
+				if ((idx0 & in_controlMask) == in_controlMask)
+					in_run(amps + idx0, amps + idx0 + stride, length);
+			}
+
+		}
+
+		// Calls in_run(p, length) over runs of contiguous amplitudes covering the quadruples a gate on
+		// in_qubit0 and in_qubit1 mixes: p[k] has the in_qubit0 bit set if k & 1, the in_qubit1 bit if k & 2.
+		template <typename Run>
+		void forEachQuadRun(StateVector &io_state, int in_qubit0, int in_qubit1, Run in_run) {
+
+			const int low = in_qubit0 < in_qubit1 ? in_qubit0 : in_qubit1;
+			const int high = in_qubit0 < in_qubit1 ? in_qubit1 : in_qubit0;
+			const uint64_t length = minLength(1ULL << low, MAX_RUN_LENGTH);
+			const long long nbRuns = io_state.numAmps() / 4 / length;
+			Amplitude *amps = io_state.data();
+
+			#pragma omp parallel for schedule(static) if(io_state.numAmps() >= MIN_PARALLEL_AMPS)
+			for (long long r = 0; r < nbRuns; ++r) {
+				const uint64_t idx = insertZeroBit(insertZeroBit(r * length, low), high);
+				Amplitude *p[4] = {amps + idx, amps + idx + (1ULL << in_qubit0),
+								   amps + idx + (1ULL << in_qubit1), amps + idx + (1ULL << in_qubit0) + (1ULL << in_qubit1)};
+				in_run(p, length);
+			}
+
+		}
+
+		void swapRuns(Amplitude *io_a, Amplitude *io_b, uint64_t in_length) {
+			uint64_t j = 0;
+#ifdef QUACC_NATIVE_SIMD
+			for (; j + SIMD_WIDTH <= in_length; j += SIMD_WIDTH) {
+				const Vec a = load(io_a + j);
+				store(io_a + j, load(io_b + j));
+				store(io_b + j, a);
+			}
+#endif
+			for (; j < in_length; ++j) {
+				const Amplitude a = io_a[j];
+				io_a[j] = io_b[j];
+				io_b[j] = a;
+			}
+		}
+
+		void scaleRun(Amplitude *io_a, uint64_t in_length, Amplitude in_factor) {
+			uint64_t j = 0;
+#ifdef QUACC_NATIVE_SIMD
+			const Vec re = broadcast(in_factor.real());
+			const Vec im = broadcast(in_factor.imag());
+			for (; j + SIMD_WIDTH <= in_length; j += SIMD_WIDTH)
+				store(io_a + j, mul(load(io_a + j), re, im));
+#endif
+			for (; j < in_length; ++j)
+				io_a[j] = cmul(io_a[j], in_factor);
+		}
+
+		template <typename BlockSum>
+		double sumOverBlocks(long long in_size, BlockSum in_blockSum) {
+
+			const long long nbBlocks = in_size < NB_BLOCKS ? (in_size > 0 ? in_size : 1) : NB_BLOCKS;
+			const long long blockSize = (in_size + nbBlocks - 1) / nbBlocks;
+			double partialSums[NB_BLOCKS] = {};
+
+			#pragma omp parallel for schedule(static) if(in_size >= (long long)MIN_PARALLEL_AMPS)
+			for (long long b = 0; b < nbBlocks; ++b)
+				partialSums[b] = in_blockSum(b * blockSize < in_size ? b * blockSize : in_size,
+											 (b + 1) * blockSize < in_size ? (b + 1) * blockSize : in_size);
+
+			double result = 0.0;
+			for (long long b = 0; b < nbBlocks; ++b)
+				result += partialSums[b];
+			return result;
+
+		}
+
+		void applyMatrix1(StateVector &io_state, int in_target, const Amplitude *in_matrix, uint64_t in_controlMask) {
+
+			const Amplitude m00 = in_matrix[0], m01 = in_matrix[1], m10 = in_matrix[2], m11 = in_matrix[3];
+
+			forEachPairRun(io_state, in_target, in_controlMask, [&](Amplitude *io_p0, Amplitude *io_p1, uint64_t in_length) {
+				uint64_t j = 0;
+#ifdef QUACC_NATIVE_SIMD
+				if (in_length >= SIMD_WIDTH) {
+					const Vec m00r = broadcast(m00.real()), m00i = broadcast(m00.imag());
+					const Vec m01r = broadcast(m01.real()), m01i = broadcast(m01.imag());
+					const Vec m10r = broadcast(m10.real()), m10i = broadcast(m10.imag());
+					const Vec m11r = broadcast(m11.real()), m11i = broadcast(m11.imag());
+					for (; j < in_length; j += SIMD_WIDTH) {
+						const Vec a = load(io_p0 + j);
+						const Vec b = load(io_p1 + j);
+						store(io_p0 + j, add(mul(a, m00r, m00i), mul(b, m01r, m01i)));
+						store(io_p1 + j, add(mul(a, m10r, m10i), mul(b, m11r, m11i)));
+					}
+				}
+#endif
+				for (; j < in_length; ++j) {
+					const Amplitude a = io_p0[j];
+					const Amplitude b = io_p1[j];
+					io_p0[j] = cmul(m00, a) + cmul(m01, b);
+					io_p1[j] = cmul(m10, a) + cmul(m11, b);
+				}
+			});
+
+		}
+
+		void applyDiagonal1(StateVector &io_state, int in_target, Amplitude in_d0, Amplitude in_d1, uint64_t in_controlMask) {
+
+			// Phase gates (Z, S, T, CZ, CPhase...) leave the amplitudes with the target bit unset untouched.
+			const bool scaleP0 = in_d0 != Amplitude(1.0);
+
+			forEachPairRun(io_state, in_target, in_controlMask, [&](Amplitude *io_p0, Amplitude *io_p1, uint64_t in_length) {
+				if (scaleP0)
+					scaleRun(io_p0, in_length, in_d0);
+				scaleRun(io_p1, in_length, in_d1);
+			});
+
+		}
+
+		void applyX(StateVector &io_state, int in_target, uint64_t in_controlMask) {
+			forEachPairRun(io_state, in_target, in_controlMask, swapRuns);
+		}
+
+		void applySwap(StateVector &io_state, int in_qubit0, int in_qubit1) {
+			forEachQuadRun(io_state, in_qubit0, in_qubit1, [](Amplitude **io_p, uint64_t in_length) {
+				swapRuns(io_p[1], io_p[2], in_length);
+			});
+		}
+
+		void applyMatrix2(StateVector &io_state, int in_qubit0, int in_qubit1, const Amplitude *in_matrix) {
+
+			forEachQuadRun(io_state, in_qubit0, in_qubit1, [&](Amplitude **io_p, uint64_t in_length) {
+				uint64_t j = 0;
+#ifdef QUACC_NATIVE_SIMD
+				for (; j + SIMD_WIDTH <= in_length; j += SIMD_WIDTH) {
+					const Vec v[4] = {load(io_p[0] + j), load(io_p[1] + j), load(io_p[2] + j), load(io_p[3] + j)};
+					for (int r = 0; r < 4; ++r) {
+						Vec sum = mul(v[0], broadcast(in_matrix[4 * r].real()), broadcast(in_matrix[4 * r].imag()));
+						for (int c = 1; c < 4; ++c)
+							sum = add(sum, mul(v[c], broadcast(in_matrix[4 * r + c].real()), broadcast(in_matrix[4 * r + c].imag())));
+						store(io_p[r] + j, sum);
+					}
+				}
+#endif
+				for (; j < in_length; ++j) {
+					const Amplitude v[4] = {io_p[0][j], io_p[1][j], io_p[2][j], io_p[3][j]};
+					for (int r = 0; r < 4; ++r)
+						io_p[r][j] = cmul(in_matrix[4 * r], v[0]) + cmul(in_matrix[4 * r + 1], v[1]) +
+									 cmul(in_matrix[4 * r + 2], v[2]) + cmul(in_matrix[4 * r + 3], v[3]);
+				}
+			});
+
+		}
+
+		double calcProbabilityOfOne(const StateVector &in_state, int in_qubit) {
+
+			const Amplitude *amps = in_state.data();
+			const uint64_t bit = 1ULL << in_qubit;
+
+			return sumOverBlocks(in_state.numAmps() / 2, [&](long long in_begin, long long in_end) {
+				double sum = 0.0;
+				for (long long i = in_begin; i < in_end; ++i)
+					sum += probability(amps[insertZeroBit(i, in_qubit) | bit]);
+				return sum;
+			});
+
+		}
+
+		void collapse(StateVector &io_state, int in_qubit, int in_outcome, double in_probability) {
+
+			const double norm = 1.0 / std::sqrt(in_probability);
+
+			forEachPairRun(io_state, in_qubit, 0, [&](Amplitude *io_p0, Amplitude *io_p1, uint64_t in_length) {
+				Amplitude *kept = in_outcome ? io_p1 : io_p0;
+				Amplitude *discarded = in_outcome ? io_p0 : io_p1;
+				for (uint64_t j = 0; j < in_length; ++j)
+					discarded[j] = 0.0;
+				scaleRun(kept, in_length, norm);
+			});
+
+		}
+
+		double calcExpectationValueZ(const StateVector &in_state, uint64_t in_zMask) {
+
+			const Amplitude *amps = in_state.data();
+
+			return sumOverBlocks(in_state.numAmps(), [&](long long in_begin, long long in_end) {
+				double sum = 0.0;
+				for (long long i = in_begin; i < in_end; ++i)
+					sum += (__builtin_parityll(i & in_zMask) ? -1.0 : 1.0) * probability(amps[i]);
+				return sum;
+			});
+
+		}
+
+	}
+
+	const KernelTable QUACC_NATIVE_KERNELS = {
+		SIMD_PATH,
+		applyMatrix1,
+		applyDiagonal1,
+		applyX,
+		applySwap,
+		applyMatrix2,
+		calcProbabilityOfOne,
+		collapse,
+		calcExpectationValueZ
+	};
+
+} // namespace native
+} // namespace quacc
@@ -0,0 +1,129 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#include "NativeStateVector.hpp"
+
+namespace quacc {
+namespace native {
+
+	StateVector::StateVector(int in_nbQubits) {
+		allocate(in_nbQubits);
+		setZeroState();
+	}
+
+	StateVector::StateVector(const StateVector &in_other) {
+		if (!in_other.amplitudes)
+			return;
+		allocate(in_other.nbQubits);
+
+		#pragma omp parallel for schedule(static)
+		for (long long i = 0; i < (long long)nbAmps; ++i)
+			amplitudes[i] = in_other.amplitudes[i];
+	}
+
+	StateVector::StateVector(StateVector &&in_other) noexcept
+		: nbQubits(in_other.nbQubits), nbAmps(in_other.nbAmps), amplitudes(in_other.amplitudes) {
+		in_other.nbQubits = 0;
+		in_other.nbAmps = 0;
+		in_other.amplitudes = nullptr;
+	}
+
+	StateVector& StateVector::operator=(const StateVector &in_other) {
+
+		if (this == &in_other)
+			return *this;
+
+		if (nbQubits != in_other.nbQubits || !in_other.amplitudes) {
+			release();
+			if (!in_other.amplitudes)
+				return *this;
+			allocate(in_other.nbQubits);
+		}
+
+		#pragma omp parallel for schedule(static)
+		for (long long i = 0; i < (long long)nbAmps; ++i)
+			amplitudes[i] = in_other.amplitudes[i];
+
+		return *this;
+
+	}
+
+	StateVector& StateVector::operator=(StateVector &&in_other) noexcept {
+		std::swap(nbQubits, in_other.nbQubits);
+		std::swap(nbAmps, in_other.nbAmps);
+		std::swap(amplitudes, in_other.amplitudes);
+		return *this;
+	}
+
+	StateVector::~StateVector() {
+		release();
+	}
+
+	void StateVector::setZeroState() {
+
+		// Written by the threads that will later process the same blocks (first touch).
+		#pragma omp parallel for schedule(static)
+		for (long long i = 0; i < (long long)nbAmps; ++i)
+			amplitudes[i] = 0.0;
+
+		if (nbAmps > 0)
+			amplitudes[0] = 1.0;
+
+	}
+
+	void StateVector::allocate(int in_nbQubits) {
+
+		nbQubits = in_nbQubits;
+		nbAmps = 1ULL << in_nbQubits;
+
+		// aligned_alloc requires a size multiple of the alignment
+		size_t bytes = nbAmps * sizeof(Amplitude);
+		bytes = (bytes + AMPLITUDE_ALIGNMENT - 1) / AMPLITUDE_ALIGNMENT * AMPLITUDE_ALIGNMENT;
+
+		amplitudes = static_cast<Amplitude*>(std::aligned_alloc(AMPLITUDE_ALIGNMENT, bytes));
+		if (!amplitudes)
+			throw std::bad_alloc();
+
+	}
+
+	void StateVector::release() {
+		std::free(amplitudes);
+		amplitudes = nullptr;
+		nbQubits = 0;
+		nbAmps = 0;
+	}
+
+} // namespace native
+} // namespace quacc
@@ -0,0 +1,84 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+
+#ifndef QUACC_NATIVE_STATE_VECTOR_HPP_
+#define QUACC_NATIVE_STATE_VECTOR_HPP_
+
+#include <complex>
+#include <cstddef>
+#include <cstdint>
+
+namespace quacc {
+namespace native {
+
+	typedef std::complex<double> Amplitude;
+
+	// Alignment of the amplitudes: one cache line, the width of an AVX-512 register.
+	constexpr size_t AMPLITUDE_ALIGNMENT = 64;
+
+	// State vector of a register, the amplitudes being stored interleaved (re, im, re, im, ...)
+	// in aligned memory so that the kernels can use aligned vector loads.
+	class StateVector {
+
+		public:
+
+		  StateVector() = default;
+		  // The |0...0> state of in_nbQubits qubits
+		  explicit StateVector(int in_nbQubits);
+		  StateVector(const StateVector &in_other);
+		  StateVector(StateVector &&in_other) noexcept;
+		  StateVector& operator=(const StateVector &in_other);
+		  StateVector& operator=(StateVector &&in_other) noexcept;
+		  ~StateVector();
+
+		  int numQubits() const { return nbQubits; }
+		  uint64_t numAmps() const { return nbAmps; }
+
+		  Amplitude* data() { return amplitudes; }
+		  const Amplitude* data() const { return amplitudes; }
+		  Amplitude& operator[](uint64_t in_idx) { return amplitudes[in_idx]; }
+		  const Amplitude& operator[](uint64_t in_idx) const { return amplitudes[in_idx]; }
+
+		  void setZeroState();
+
+		private:
+
+		  void allocate(int in_nbQubits);
+		  void release();
+
+		  int nbQubits = 0;
+		  uint64_t nbAmps = 0;
+		  Amplitude *amplitudes = nullptr;
+	};
+
+} // namespace native
+} // namespace quacc
+
+#endif /* QUACC_NATIVE_STATE_VECTOR_HPP_ */
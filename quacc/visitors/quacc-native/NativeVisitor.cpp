@@ -0,0 +1,306 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include "AllGateVisitor.hpp"
+#include "NativeVisitor.hpp"
+#include "NativeKernels.hpp"
+
+namespace quacc {
+
+	namespace {
+		using native::Amplitude;
+
+		const Amplitude I(0.0, 1.0);
+
+		double parameter(Gate &in_gate, int in_idx) {
+			return InstructionParameterToDouble(in_gate.getParameter(in_idx));
+		}
+
+		uint64_t bitMask(const std::set<size_t> &in_bits) {
+			uint64_t mask = 0;
+			for (const auto &bit : in_bits)
+				mask |= 1ULL << bit;
+			return mask;
+		}
+	}
+
+	NativeVisitor::NativeVisitor() : rng(std::random_device{}()) {}
+
+	NativeVisitor::~NativeVisitor() {}
+
+	void NativeVisitor::initialize(std::shared_ptr<AcceleratorBuffer> accbuffer_in) {
+
+		verbose = false;
+		if(xacc::optionExists("quest-verbose"))
+			verbose = xacc::getOption("quest-verbose") == "true";
+
+		testing = false;
+		if(xacc::optionExists("quest-testing"))
+			testing = xacc::getOption("quest-testing") == "true";
+
+		// The global register is a QuEST one, which the native state vector cannot stand for
+		if(xacc::optionExists("use_global_qreg") && xacc::getOption("use_global_qreg") == "true")
+			xacc::error("NativeVisitor: use_global_qreg is only supported by the quest-default backend");
+
+		buffer = accbuffer_in;
+		n_qbits = accbuffer_in->size();
+		// Only the active qubits are simulated
+		bufferQubits = activeQubits;
+		if(!bufferQubits.empty())
+			n_qbits = bufferQubits.size();
+		activeQubits.clear();
+		registerQubits.resize(accbuffer_in->size());
+		std::iota(registerQubits.begin(), registerQubits.end(), 0);
+		for(size_t q = 0; q < bufferQubits.size(); ++q)
+			registerQubits[bufferQubits[q]] = q;
+
+		if(options.keyExists<int>("seed"))
+			rng.seed(options.get<int>("seed"));
+
+		const std::string simdPath = options.stringExists("simd-path") ? options.getString("simd-path") : "auto";
+		if(!kernels.select(simdPath))
+			xacc::error("NativeVisitor: the " + simdPath + " kernels are not available on this CPU");
+
+		if(ansatzState.numQubits() == n_qbits && ansatzState.data())
+			ansatzState.setZeroState();
+		else
+			ansatzState = native::StateVector(n_qbits);
+		state = &ansatzState;
+
+		measured_bits.clear();
+		initialized = true;
+
+	}
+
+	void NativeVisitor::finalize() {
+
+		if(initialized && testing)
+			updateStateVectorInfo();
+
+		initialized = false;
+		state = nullptr;
+
+		executionInfo.insert("register-qubits", n_qbits);
+		executionInfo.insert("simd-path", std::string(kernels.simdPath()));
+
+	}
+
+	void NativeVisitor::updateStateVectorInfo(){
+
+		// On the buffer qubits, those left out of the register being in |0>
+		const uint64_t nbAmps = 1ULL << buffer->size();
+		std::vector<double> stateVectReal(nbAmps);
+		std::vector<double> stateVectImag(nbAmps);
+
+		for(uint64_t i = 0; i < state->numAmps(); ++i){
+			uint64_t index = i;
+			if(!bufferQubits.empty()){
+				index = 0;
+				for(size_t bit = 0; bit < bufferQubits.size(); ++bit)
+					index |= ((i >> bit) & 1ULL) << bufferQubits[bit];
+			}
+			stateVectReal[index] = (*state)[i].real();
+			stateVectImag[index] = (*state)[i].imag();
+		}
+
+		buffer->addExtraInfo("statevect_real", stateVectReal);
+		buffer->addExtraInfo("statevect_imag", stateVectImag);
+
+	}
+
+	const double NativeVisitor::getExpectationValueZ(std::shared_ptr<CompositeInstruction> function){
+
+		// The change of basis is applied to a copy of the ansatz state,
+		// so that the ansatz state remains available for the next terms.
+		termState = ansatzState;
+		state = &termState;
+
+		std::set<size_t> measureBitIdxs;
+
+		InstructionIterator it(function);
+		while (it.hasNext())
+		{
+			auto nextInst = it.next();
+			if (nextInst->isEnabled() && !nextInst->isComposite())
+			{
+				if (nextInst->name() == "Measure")
+					measureBitIdxs.insert(registerQubits[nextInst->bits()[0]]);
+				else
+					nextInst->accept(this);
+			}
+		}
+
+		const double result = kernels.calcExpectationValueZ(termState, bitMask(measureBitIdxs));
+
+		state = &ansatzState;
+
+		return result;
+
+	}
+
+	void NativeVisitor::visit(Measure &gate) {
+
+		const size_t bit = gate.bits()[0];
+		const int registerBit = qubit(gate, 0);
+		measured_bits.insert(registerBit);
+
+		if (verbose) {
+			std::cout << "applying " << gate.name() << " @ " << bit << std::endl;
+		}
+
+		buffer->addExtraInfo("exp-val-z", kernels.calcExpectationValueZ(*state, bitMask(measured_bits)));
+
+		const double probabilityOfOne = kernels.calcProbabilityOfOne(*state, registerBit);
+		const int measured = std::uniform_real_distribution<double>(0.0, 1.0)(rng) < probabilityOfOne ? 1 : 0;
+		kernels.collapse(*state, registerBit, measured, measured ? probabilityOfOne : 1.0 - probabilityOfOne);
+
+		buffer->measure(bit, measured);
+
+		if(testing){
+			updateStateVectorInfo();
+		}
+
+	}
+
+	void NativeVisitor::visit(Hadamard &gate) {
+		const Amplitude matrix[4] = {M_SQRT1_2, M_SQRT1_2, M_SQRT1_2, -M_SQRT1_2};
+		kernels.applyMatrix1(*state, qubit(gate, 0), matrix);
+	}
+
+	void NativeVisitor::visit(X &gate) {
+		kernels.applyX(*state, qubit(gate, 0));
+	}
+
+	void NativeVisitor::visit(Y &gate) {
+		const Amplitude matrix[4] = {0., -I, I, 0.};
+		kernels.applyMatrix1(*state, qubit(gate, 0), matrix);
+	}
+
+	void NativeVisitor::visit(Z &gate) {
+		kernels.applyDiagonal1(*state, qubit(gate, 0), 1., -1.);
+	}
+
+	void NativeVisitor::visit(Rx &gate) {
+		const double theta = parameter(gate, 0);
+		const double c = std::cos(theta / 2.), s = std::sin(theta / 2.);
+		const Amplitude matrix[4] = {c, -I * s, -I * s, c};
+		kernels.applyMatrix1(*state, qubit(gate, 0), matrix);
+	}
+
+	void NativeVisitor::visit(Ry &gate) {
+		const double theta = parameter(gate, 0);
+		const double c = std::cos(theta / 2.), s = std::sin(theta / 2.);
+		const Amplitude matrix[4] = {c, -s, s, c};
+		kernels.applyMatrix1(*state, qubit(gate, 0), matrix);
+	}
+
+	void NativeVisitor::visit(Rz &gate) {
+		const double theta = parameter(gate, 0);
+		kernels.applyDiagonal1(*state, qubit(gate, 0), std::polar(1., -theta / 2.), std::polar(1., theta / 2.));
+	}
+
+	void NativeVisitor::visit(U &gate) {
+		const double theta = parameter(gate, 0);
+		const double phi = parameter(gate, 1);
+		const double lambda = parameter(gate, 2);
+		const double c = std::cos(theta / 2.), s = std::sin(theta / 2.);
+		const Amplitude matrix[4] = {c, -s * std::polar(1., lambda), s * std::polar(1., phi), c * std::polar(1., phi + lambda)};
+		kernels.applyMatrix1(*state, qubit(gate, 0), matrix);
+	}
+
+	void NativeVisitor::visit(S &gate) {
+		kernels.applyDiagonal1(*state, qubit(gate, 0), 1., I);
+	}
+
+	void NativeVisitor::visit(Sdg &gate) {
+		kernels.applyDiagonal1(*state, qubit(gate, 0), 1., -I);
+	}
+
+	void NativeVisitor::visit(T &gate) {
+		kernels.applyDiagonal1(*state, qubit(gate, 0), 1., std::polar(1., M_PI_4));
+	}
+
+	void NativeVisitor::visit(Tdg &gate) {
+		kernels.applyDiagonal1(*state, qubit(gate, 0), 1., std::polar(1., -M_PI_4));
+	}
+
+	void NativeVisitor::visit(CNOT &gate) {
+		kernels.applyX(*state, qubit(gate, 1), 1ULL << qubit(gate, 0));
+	}
+
+	void NativeVisitor::visit(CY &gate) {
+		const Amplitude matrix[4] = {0., -I, I, 0.};
+		kernels.applyMatrix1(*state, qubit(gate, 1), matrix, 1ULL << qubit(gate, 0));
+	}
+
+	void NativeVisitor::visit(CZ &gate) {
+		kernels.applyDiagonal1(*state, qubit(gate, 1), 1., -1., 1ULL << qubit(gate, 0));
+	}
+
+	void NativeVisitor::visit(CH &gate) {
+		const Amplitude matrix[4] = {M_SQRT1_2, M_SQRT1_2, M_SQRT1_2, -M_SQRT1_2};
+		kernels.applyMatrix1(*state, qubit(gate, 1), matrix, 1ULL << qubit(gate, 0));
+	}
+
+	void NativeVisitor::visit(CRZ &gate) {
+		const double theta = parameter(gate, 0);
+		kernels.applyDiagonal1(*state, qubit(gate, 1), std::polar(1., -theta / 2.), std::polar(1., theta / 2.), 1ULL << qubit(gate, 0));
+	}
+
+	void NativeVisitor::visit(CPhase &gate) {
+		kernels.applyDiagonal1(*state, qubit(gate, 1), 1., std::polar(1., parameter(gate, 0)), 1ULL << qubit(gate, 0));
+	}
+
+	void NativeVisitor::visit(Swap &gate) {
+		kernels.applySwap(*state, qubit(gate, 0), qubit(gate, 1));
+	}
+
+	void NativeVisitor::visit(iSwap &gate) {
+		const Amplitude matrix[16] = {1., 0., 0., 0.,
+									  0., 0., I, 0.,
+									  0., I, 0., 0.,
+									  0., 0., 0., 1.};
+		kernels.applyMatrix2(*state, qubit(gate, 0), qubit(gate, 1), matrix);
+	}
+
+	void NativeVisitor::visit(fSim &gate) {
+		const double theta = parameter(gate, 0);
+		const double phi = parameter(gate, 1);
+		const double c = std::cos(theta), s = std::sin(theta);
+		const Amplitude matrix[16] = {1., 0., 0., 0.,
+									  0., c, -I * s, 0.,
+									  0., -I * s, c, 0.,
+									  0., 0., 0., std::polar(1., -phi)};
+		kernels.applyMatrix2(*state, qubit(gate, 0), qubit(gate, 1), matrix);
+	}
+
+} // namespace quacc
@@ -0,0 +1,139 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#ifndef QUACC_NATIVE_VISITOR_HPP_
+#define QUACC_NATIVE_VISITOR_HPP_
+
+#include <random>
+#include <set>
+#include <vector>
+#include "Cloneable.hpp"
+
+#include "../QuaccVisitor.hpp"
+#include "NativeKernels.hpp"
+#include "NativeStateVector.hpp"
+
+namespace quacc {
+
+// Visitor simulating the kernels on its own state vector, with vectorized kernels,
+// instead of going through QuEST. Selected with the "backend" option set to "quacc-native".
+class NativeVisitor : public xQuaccVisitor {
+
+public:
+  NativeVisitor();
+  virtual ~NativeVisitor();
+
+  virtual std::shared_ptr<xQuaccVisitor> clone() {
+    return std::make_shared<NativeVisitor>();
+  }
+
+  virtual const double getExpectationValueZ(std::shared_ptr<CompositeInstruction> function);
+
+  virtual void initialize(std::shared_ptr<AcceleratorBuffer> buffer) override;
+  virtual void finalize() override;
+
+  // The ansatz state is simulated once and each observed term is evaluated against a copy of it.
+  virtual bool supportVqeMode() const override { return true; }
+  // Qubits left out of the register are put back, in |0>, in the reported state.
+  virtual bool supportActiveQubits() const override { return true; }
+
+  // Service name as defined in manifest.json
+  virtual const std::string name() const { return "quacc-native"; }
+
+  virtual const std::string description() const { return ""; }
+
+  virtual OptionPairs getOptions() {
+
+	OptionPairs desc{{"seed","Seed of the measurement outcomes"},
+					 {"simd-path","Kernel variant: auto (default), avx512, avx2, sse4.2 or scalar"}};
+    return desc;
+  }
+
+  // one-qubit gates
+  void visit(Identity &gate) {}
+  void visit(Hadamard &gate);
+  void visit(X &gate);
+  void visit(Y &gate);
+  void visit(Z &gate);
+  void visit(Rx &gate);
+  void visit(Ry &gate);
+  void visit(Rz &gate);
+  void visit(U &gate);
+  void visit(S &gate);
+  void visit(Sdg &gate);
+  void visit(T &gate);
+  void visit(Tdg &gate);
+
+  // two-qubit gates
+  void visit(CNOT &gate);
+  void visit(CY &gate);
+  void visit(CZ &gate);
+  void visit(CH &gate);
+  void visit(CRZ &gate);
+  void visit(CPhase &gate);
+  void visit(Swap &gate);
+  void visit(iSwap &gate);
+  void visit(fSim &gate);
+
+  // others
+  void visit(Measure &gate);
+
+private:
+
+  // Register the gates are applied to: the ansatz state, or in getExpectationValueZ() the
+  // copy of it the change of basis of the observed term is applied to.
+  native::StateVector *state = nullptr;
+  native::StateVector ansatzState;
+  native::StateVector termState;
+
+  bool initialized = false;
+  bool verbose = false, testing = false;
+
+  int n_qbits = 0;
+  // Register qubits, of the measurements so far
+  std::set<size_t> measured_bits;
+  // Buffer qubit of each register qubit when only the active qubits are simulated, empty otherwise,
+  // and register qubit of each buffer qubit
+  std::vector<size_t> bufferQubits;
+  std::vector<size_t> registerQubits;
+
+  // Kernel variant of this visitor, see the "simd-path" option
+  native::Kernels kernels;
+
+  std::mt19937_64 rng;
+
+  void updateStateVectorInfo(); //used for testing
+
+  // Register qubit the in_idx-th bit of in_gate acts on
+  int qubit(Gate &in_gate, int in_idx) const { return registerQubits[in_gate.bits()[in_idx]]; }
+
+};
+
+} // namespace quacc
+#endif /* QUACC_NATIVE_VISITOR_HPP_ */
@@ -0,0 +1,955 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <map>
+#include <numeric>
+
+#include "GateOps.hpp"
+
+namespace quacc {
+
+	namespace {
+		typedef std::complex<double> Amplitude;
+		const Amplitude I(0.0, 1.0);
+
+		// in_a * in_b for row-major square matrices of dimension in_dim
+		std::vector<Amplitude> multiply(const std::vector<Amplitude> &in_a, const std::vector<Amplitude> &in_b, size_t in_dim) {
+			std::vector<Amplitude> result(in_dim * in_dim, 0.0);
+			for (size_t r = 0; r < in_dim; ++r)
+				for (size_t k = 0; k < in_dim; ++k)
+					for (size_t c = 0; c < in_dim; ++c)
+						result[r * in_dim + c] += in_a[r * in_dim + k] * in_b[k * in_dim + c];
+			return result;
+		}
+
+		// Phases of a diagonal gate, up to the lowering of its matrix
+		std::vector<kernels::PhaseTerm> phaseTerms(const GateOp &in_op) {
+			uint64_t mask = 0;
+			for (const auto &qubit : in_op.qubits)
+				mask |= 1ULL << qubit;
+			switch (in_op.kind) {
+				case GateOp::Z:			return {{mask, M_PI}};
+				case GateOp::Rz:		return {{0, -in_op.params[0] / 2.}, {mask, in_op.params[0]}};
+				case GateOp::CZ:		return {{mask, M_PI}};
+				case GateOp::CPhase:	return {{mask, in_op.params[0]}};
+				default:				return in_op.phases;
+			}
+		}
+
+		// Matrix of in_op over in_qubits, a superset of its own qubits
+		std::vector<Amplitude> expand(const GateOp &in_op, const std::vector<int> &in_qubits) {
+
+			if (in_op.qubits == in_qubits)
+				return in_op.matrix;
+
+			// Position in in_qubits of each qubit of in_op
+			std::vector<size_t> positions;
+			size_t opMask = 0;
+			for (const auto &qubit : in_op.qubits) {
+				positions.push_back(std::find(in_qubits.begin(), in_qubits.end(), qubit) - in_qubits.begin());
+				opMask |= 1ULL << positions.back();
+			}
+
+			const size_t dim = 1ULL << in_qubits.size();
+			const size_t opDim = 1ULL << in_op.qubits.size();
+			std::vector<Amplitude> result(dim * dim, 0.0);
+
+			for (size_t r = 0; r < dim; ++r)
+				for (size_t c = 0; c < dim; ++c) {
+					if ((r & ~opMask) != (c & ~opMask))
+						continue;
+					size_t opR = 0, opC = 0;
+					for (size_t i = 0; i < positions.size(); ++i) {
+						opR |= ((r >> positions[i]) & 1ULL) << i;
+						opC |= ((c >> positions[i]) & 1ULL) << i;
+					}
+					result[r * dim + c] = in_op.matrix[opR * opDim + opC];
+				}
+
+			return result;
+		}
+
+		// Basis state permutation of an X, CNOT or Swap gate on in_qubits
+		kernels::BitPermutation bitPermutation(GateOp::Kind in_kind, const int *in_qubits, int in_nbQubits) {
+			kernels::BitPermutation permutation = {0, 0, 0};
+			if (in_kind == GateOp::Swap) {
+				permutation.swapMask = (1ULL << in_qubits[0]) | (1ULL << in_qubits[1]);
+				return permutation;
+			}
+			// The target is the last qubit, the others are controls
+			for (int i = 0; i + 1 < in_nbQubits; ++i)
+				permutation.controlMask |= 1ULL << in_qubits[i];
+			permutation.flipMask = 1ULL << in_qubits[in_nbQubits - 1];
+			return permutation;
+		}
+	}
+
+	GateOp GateOp::lower(Kind in_kind, const std::vector<int> &in_qubits, const std::vector<double> &in_params) {
+
+		GateOp op;
+		op.kind = in_kind;
+		op.qubits = in_qubits;
+		op.params = in_params;
+
+		const double theta = in_params.empty() ? 0.0 : in_params[0];
+		const double c = std::cos(theta / 2.);
+		const double s = std::sin(theta / 2.);
+
+		switch (in_kind) {
+			case H:
+				op.matrix = {M_SQRT1_2, M_SQRT1_2, M_SQRT1_2, -M_SQRT1_2};
+				break;
+			case X:
+				op.matrix = {0., 1., 1., 0.};
+				break;
+			case Y:
+				op.matrix = {0., -I, I, 0.};
+				break;
+			case Z:
+				op.matrix = {1., 0., 0., -1.};
+				break;
+			case Rx:
+				op.matrix = {c, -I * s, -I * s, c};
+				break;
+			case Ry:
+				op.matrix = {c, -s, s, c};
+				break;
+			case Rz:
+				op.matrix = {std::exp(-I * theta / 2.), 0., 0., std::exp(I * theta / 2.)};
+				break;
+			case U: {
+				const double phi = in_params[1];
+				const double lambda = in_params[2];
+				op.matrix = {c, -std::exp(I * lambda) * s, std::exp(I * phi) * s, std::exp(I * (phi + lambda)) * c};
+				break;
+			}
+			// Two-qubit gates, qubits = {control, target}: index bit 0 is the control, bit 1 the target
+			case CNOT:
+				op.matrix = {1., 0., 0., 0.,
+							 0., 0., 0., 1.,
+							 0., 0., 1., 0.,
+							 0., 1., 0., 0.};
+				break;
+			case CZ:
+				op.matrix = {1., 0., 0., 0.,
+							 0., 1., 0., 0.,
+							 0., 0., 1., 0.,
+							 0., 0., 0., -1.};
+				break;
+			case CPhase:
+				op.matrix = {1., 0., 0., 0.,
+							 0., 1., 0., 0.,
+							 0., 0., 1., 0.,
+							 0., 0., 0., std::exp(I * theta)};
+				break;
+			case Swap:
+				op.matrix = {1., 0., 0., 0.,
+							 0., 0., 1., 0.,
+							 0., 1., 0., 0.,
+							 0., 0., 0., 1.};
+				break;
+			case Fused:
+			case Diagonal:
+			case Permutation:
+			case Window:
+			case Layer:
+				break;
+		}
+
+		return op;
+
+	}
+
+	GateOp GateOp::adjoint() const {
+
+		GateOp inverse = *this;
+
+		if (kind == Diagonal) {
+			for (auto &term : inverse.phases)
+				term.angle = -term.angle;
+			return inverse;
+		}
+
+		// Permutation gates are their own inverse
+		if (isPermutation()) {
+			std::reverse(inverse.permutations.begin(), inverse.permutations.end());
+			return inverse;
+		}
+
+		inverse.kind = Fused;
+		const size_t dim = 1ULL << qubits.size();
+		for (size_t r = 0; r < dim; ++r)
+			for (size_t c = 0; c < dim; ++c)
+				inverse.matrix[r * dim + c] = std::conj(matrix[c * dim + r]);
+
+		return inverse;
+
+	}
+
+	std::vector<Amplitude> GateOp::derivative(size_t in_param) const {
+
+		const double theta = params[0];
+		const double c = std::cos(theta / 2.);
+		const double s = std::sin(theta / 2.);
+
+		switch (kind) {
+			case Rx:
+				return {-s / 2., -I * c / 2., -I * c / 2., -s / 2.};
+			case Ry:
+				return {-s / 2., -c / 2., c / 2., -s / 2.};
+			case Rz:
+				return {-I / 2. * std::exp(-I * theta / 2.), 0., 0., I / 2. * std::exp(I * theta / 2.)};
+			case CPhase:
+				return {0., 0., 0., 0.,
+						0., 0., 0., 0.,
+						0., 0., 0., 0.,
+						0., 0., 0., I * std::exp(I * theta)};
+			case U: {
+				const Amplitude ePhi = std::exp(I * params[1]);
+				const Amplitude eLambda = std::exp(I * params[2]);
+				if (in_param == 0)
+					return {-s / 2., -eLambda * c / 2., ePhi * c / 2., -ePhi * eLambda * s / 2.};
+				if (in_param == 1)
+					return {0., 0., I * ePhi * s, I * ePhi * eLambda * c};
+				return {0., -I * eLambda * s, 0., I * ePhi * eLambda * c};
+			}
+			default:
+				break;
+		}
+
+		// Other gates have no parameter
+		return std::vector<Amplitude>(matrix.size(), 0.0);
+
+	}
+
+	std::vector<GateOp> accumulateDiagonalGates(const std::vector<GateOp> &in_ops, int in_minQubits) {
+
+		std::vector<GateOp> result;
+		// Gates of each run, by position in result
+		std::map<size_t, std::vector<GateOp>> runGates;
+		// Per qubit, the position in result of the last op acting on it
+		std::map<int, size_t> lastOps;
+		bool hasOpenRun = false;
+		size_t openRun = 0;
+
+		for (const auto &op : in_ops) {
+
+			size_t position = result.size();
+
+			if (op.isDiagonal() && op.kind != GateOp::Diagonal) {
+
+				bool joinsRun = hasOpenRun;
+				for (const auto &qubit : op.qubits) {
+					const auto lastOp = lastOps.find(qubit);
+					if (lastOp != lastOps.end() && lastOp->second > openRun)
+						joinsRun = false;
+				}
+
+				if (!joinsRun) {
+					GateOp run;
+					run.kind = GateOp::Diagonal;
+					run.nbGates = 0;
+					openRun = result.size();
+					hasOpenRun = true;
+					result.push_back(run);
+				}
+
+				position = openRun;
+				auto &run = result[openRun];
+				for (const auto &qubit : op.qubits)
+					if (std::find(run.qubits.begin(), run.qubits.end(), qubit) == run.qubits.end())
+						run.qubits.push_back(qubit);
+				for (const auto &term : phaseTerms(op)) {
+					auto same = std::find_if(run.phases.begin(), run.phases.end(), [&](const kernels::PhaseTerm &in_term) { return in_term.mask == term.mask; });
+					if (same != run.phases.end())
+						same->angle += term.angle;
+					else
+						run.phases.push_back(term);
+				}
+				run.nbGates += op.nbGates;
+				run.sources.insert(run.sources.end(), op.sources.begin(), op.sources.end());
+				runGates[openRun].push_back(op);
+
+			} else {
+				result.push_back(op);
+			}
+
+			for (const auto &qubit : op.qubits)
+				lastOps[qubit] = position;
+		}
+
+		// Runs too small to be worth a pass of their own go back to separate gates
+		std::vector<GateOp> ops;
+		for (size_t i = 0; i < result.size(); ++i) {
+			const auto run = runGates.find(i);
+			if (run != runGates.end() && (run->second.size() < 2 || (int) result[i].qubits.size() < in_minQubits))
+				ops.insert(ops.end(), run->second.begin(), run->second.end());
+			else
+				ops.push_back(result[i]);
+		}
+
+		return ops;
+
+	}
+
+	std::vector<GateOp> composePermutations(const std::vector<GateOp> &in_ops, int in_minQubits) {
+
+		std::vector<GateOp> result;
+		// Gates of each run, by position in result
+		std::map<size_t, std::vector<GateOp>> runGates;
+		// Per qubit, the position in result of the last op acting on it
+		std::map<int, size_t> lastOps;
+		bool hasOpenRun = false;
+		size_t openRun = 0;
+
+		for (const auto &op : in_ops) {
+
+			size_t position = result.size();
+
+			if (op.isPermutation() && op.kind != GateOp::Permutation) {
+
+				bool joinsRun = hasOpenRun;
+				for (const auto &qubit : op.qubits) {
+					const auto lastOp = lastOps.find(qubit);
+					if (lastOp != lastOps.end() && lastOp->second > openRun)
+						joinsRun = false;
+				}
+
+				if (!joinsRun) {
+					GateOp run;
+					run.kind = GateOp::Permutation;
+					run.nbGates = 0;
+					openRun = result.size();
+					hasOpenRun = true;
+					result.push_back(run);
+				}
+
+				position = openRun;
+				auto &run = result[openRun];
+				for (const auto &qubit : op.qubits)
+					if (std::find(run.qubits.begin(), run.qubits.end(), qubit) == run.qubits.end())
+						run.qubits.push_back(qubit);
+				run.permutations.push_back(bitPermutation(op.kind, op.qubits.data(), op.qubits.size()));
+				run.nbGates += op.nbGates;
+				run.sources.insert(run.sources.end(), op.sources.begin(), op.sources.end());
+				runGates[openRun].push_back(op);
+
+			} else {
+				result.push_back(op);
+			}
+
+			for (const auto &qubit : op.qubits)
+				lastOps[qubit] = position;
+		}
+
+		std::vector<GateOp> ops;
+		for (size_t i = 0; i < result.size(); ++i) {
+			const auto run = runGates.find(i);
+			if (run != runGates.end() && (run->second.size() < 2 || (int) result[i].qubits.size() < in_minQubits))
+				ops.insert(ops.end(), run->second.begin(), run->second.end());
+			else
+				ops.push_back(result[i]);
+		}
+
+		return ops;
+
+	}
+
+	std::vector<GateOp> fuseGates(const std::vector<GateOp> &in_ops, int in_maxQubits) {
+
+		std::vector<GateOp> result;
+		// Per qubit, the block in result that last acted on it
+		std::map<int, size_t> lastBlocks;
+
+		for (const auto &op : in_ops) {
+
+			// op may only be moved back to the latest block touching its qubits,
+			// as no block after that one acts on them.
+			bool hasBlock = false;
+			size_t block = 0;
+			for (const auto &qubit : op.qubits) {
+				const auto lastBlock = lastBlocks.find(qubit);
+				if (lastBlock != lastBlocks.end() && (!hasBlock || lastBlock->second > block)) {
+					block = lastBlock->second;
+					hasBlock = true;
+				}
+			}
+
+			std::vector<int> qubits = hasBlock ? result[block].qubits : std::vector<int>();
+			for (const auto &qubit : op.qubits)
+				if (std::find(qubits.begin(), qubits.end(), qubit) == qubits.end())
+					qubits.push_back(qubit);
+
+			if (hasBlock && (int) qubits.size() <= in_maxQubits
+					&& op.kind != GateOp::Diagonal && result[block].kind != GateOp::Diagonal
+					&& op.kind != GateOp::Permutation && result[block].kind != GateOp::Permutation) {
+				auto &fused = result[block];
+				const size_t dim = 1ULL << qubits.size();
+				fused.matrix = multiply(expand(op, qubits), expand(fused, qubits), dim);
+				fused.qubits = qubits;
+				fused.kind = GateOp::Fused;
+				fused.nbGates += op.nbGates;
+				fused.sources.insert(fused.sources.end(), op.sources.begin(), op.sources.end());
+			} else {
+				block = result.size();
+				result.push_back(op);
+			}
+
+			for (const auto &qubit : op.qubits)
+				lastBlocks[qubit] = block;
+		}
+
+		return result;
+
+	}
+
+	namespace {
+		// Applies a gate on the lowest qubits with the kernels specialized for them, returns false for any other gate.
+		bool applyLowGate(Qureg &io_qreg, GateOp::Kind in_kind, const int *in_qubits, int in_nbQubits, const Amplitude *in_matrix) {
+
+			const int *q = in_qubits;
+			const Amplitude *m = in_matrix;
+
+			if (in_nbQubits > 2 || in_kind == GateOp::Diagonal || io_qreg.numQubitsInStateVec < kernels::LOW_QUBITS ||
+					*std::max_element(q, q + in_nbQubits) >= kernels::LOW_QUBITS)
+				return false;
+
+			switch (in_kind) {
+				case GateOp::CZ:
+				case GateOp::CPhase: {
+					// Block of the matrix where the control (index bit 0) is set
+					const Amplitude controlled[4] = {m[5], m[7], m[13], m[15]};
+					kernels::applyControlledMatrix1Low(io_qreg, q[0], q[1], controlled);
+					return true;
+				}
+				default:
+					if (in_nbQubits == 1)
+						kernels::applyMatrix1Low(io_qreg, q[0], m);
+					else
+						kernels::applyMatrix2Low(io_qreg, q[0], q[1], m);
+					return true;
+			}
+
+		}
+
+		// Applies a gate given by its flat description, see GateOp for the meaning of the fields.
+		void applyGate(Qureg &io_qreg, GateOp::Kind in_kind, const int *in_qubits, int in_nbQubits, const double *in_params,
+				const Amplitude *in_matrix, const kernels::PhaseTerm *in_phases, size_t in_nbPhases,
+				const kernels::BitPermutation *in_permutations, size_t in_nbPermutations) {
+
+			const int *q = in_qubits;
+			const double *p = in_params;
+			const Amplitude *m = in_matrix;
+
+			// Permutation gates only move amplitudes around
+			switch (in_kind) {
+				case GateOp::X:
+				case GateOp::CNOT:
+				case GateOp::Swap:
+					kernels::applyBitPermutation(io_qreg, bitPermutation(in_kind, q, in_nbQubits));
+					return;
+				case GateOp::Permutation:
+					kernels::applyBitPermutations(io_qreg, in_permutations, in_nbPermutations);
+					return;
+				case GateOp::Window:
+				case GateOp::Layer:
+					return;
+				default:
+					break;
+			}
+
+			if (applyLowGate(io_qreg, in_kind, q, in_nbQubits, m))
+				return;
+
+			switch (in_kind) {
+				case GateOp::H:			hadamard(io_qreg, q[0]); return;
+				case GateOp::Y:			pauliY(io_qreg, q[0]); return;
+				case GateOp::Z:			pauliZ(io_qreg, q[0]); return;
+				case GateOp::Rx:		rotateX(io_qreg, q[0], p[0]); return;
+				case GateOp::Ry:		rotateY(io_qreg, q[0], p[0]); return;
+				case GateOp::Rz:		rotateZ(io_qreg, q[0], p[0]); return;
+				case GateOp::CZ:		controlledPhaseFlip(io_qreg, q[0], q[1]); return;
+				case GateOp::CPhase:	controlledPhaseShift(io_qreg, q[0], q[1], p[0]); return;
+				case GateOp::Diagonal:	kernels::applyPhaseTerms(io_qreg, in_phases, in_nbPhases); return;
+				default:
+					break;
+			}
+
+			if (in_nbQubits == 1) {
+				ComplexMatrix2 u;
+				for (int r = 0; r < 2; ++r)
+					for (int c = 0; c < 2; ++c) {
+						u.real[r][c] = m[2 * r + c].real();
+						u.imag[r][c] = m[2 * r + c].imag();
+					}
+				unitary(io_qreg, q[0], u);
+			} else if (in_nbQubits == 2) {
+				ComplexMatrix4 u;
+				for (int r = 0; r < 4; ++r)
+					for (int c = 0; c < 4; ++c) {
+						u.real[r][c] = m[4 * r + c].real();
+						u.imag[r][c] = m[4 * r + c].imag();
+					}
+				twoQubitUnitary(io_qreg, q[0], q[1], u);
+			} else {
+				const int dim = 1 << in_nbQubits;
+				ComplexMatrixN u = createComplexMatrixN(in_nbQubits);
+				for (int r = 0; r < dim; ++r)
+					for (int c = 0; c < dim; ++c) {
+						u.real[r][c] = m[dim * r + c].real();
+						u.imag[r][c] = m[dim * r + c].imag();
+					}
+				std::vector<int> targets(q, q + in_nbQubits);
+				multiQubitUnitary(io_qreg, targets.data(), in_nbQubits, u);
+				destroyComplexMatrixN(u);
+			}
+
+		}
+
+		// Applies a gate of a window to a block of the state, as a register of its own: with the state vector
+		// kernels only (and in place, unlike applyBitPermutations()), as the QuEST functions expect a whole register.
+		void applyBlockGate(Qureg &io_block, GateOp::Kind in_kind, const int *in_qubits, int in_nbQubits,
+				const Amplitude *in_matrix, const kernels::PhaseTerm *in_phases, size_t in_nbPhases,
+				const kernels::BitPermutation *in_permutations, size_t in_nbPermutations) {
+
+			switch (in_kind) {
+				case GateOp::X:
+				case GateOp::CNOT:
+				case GateOp::Swap:
+					kernels::applyBitPermutation(io_block, bitPermutation(in_kind, in_qubits, in_nbQubits));
+					return;
+				case GateOp::Permutation:
+					for (size_t i = 0; i < in_nbPermutations; ++i)
+						kernels::applyBitPermutation(io_block, in_permutations[i]);
+					return;
+				case GateOp::Diagonal:
+					kernels::applyPhaseTerms(io_block, in_phases, in_nbPhases);
+					return;
+				default:
+					break;
+			}
+
+			if (!applyLowGate(io_block, in_kind, in_qubits, in_nbQubits, in_matrix))
+				kernels::applyMatrix(io_block, in_qubits, in_nbQubits, in_matrix);
+
+		}
+
+		// in_mask with each bit b moved to in_positions[b]
+		uint64_t moveBits(uint64_t in_mask, const std::vector<int> &in_positions) {
+			uint64_t result = 0;
+			for (; in_mask != 0; in_mask &= in_mask - 1)
+				result |= 1ULL << in_positions[__builtin_ctzll(in_mask)];
+			return result;
+		}
+	}
+
+	GateOp GateOp::relabeled(const std::vector<int> &in_positions) const {
+
+		GateOp result = *this;
+		for (auto &qubit : result.qubits)
+			qubit = in_positions[qubit];
+		for (auto &term : result.phases)
+			term.mask = moveBits(term.mask, in_positions);
+		for (auto &permutation : result.permutations)
+			permutation = {moveBits(permutation.controlMask, in_positions), moveBits(permutation.flipMask, in_positions),
+					moveBits(permutation.swapMask, in_positions)};
+
+		return result;
+
+	}
+
+	std::vector<GateOp> scheduleCacheBlocks(const std::vector<GateOp> &in_ops, int in_nbQubits, int in_blockQubits) {
+
+		// Next ops looked at to decide whether a high qubit is worth moving below in_blockQubits, and the number
+		// of them it must be used by more than the low qubit it is exchanged with, the two swaps being two passes.
+		constexpr size_t LOOKAHEAD = 32;
+		constexpr int MIN_GAIN = 3;
+
+		if (in_blockQubits < kernels::LOW_QUBITS || in_nbQubits <= in_blockQubits)
+			return in_ops;
+
+		// Qubit of in_ops each (physical) qubit currently holds, and the other way round
+		std::vector<int> positions(in_nbQubits), holders(in_nbQubits);
+		std::iota(positions.begin(), positions.end(), 0);
+		std::iota(holders.begin(), holders.end(), 0);
+		const uint64_t lowMask = (1ULL << in_blockQubits) - 1;
+
+		std::vector<GateOp> result, window, deferred;
+		uint64_t deferredMask = 0;
+
+		auto closeWindow = [&]() {
+			if (window.size() > 1) {
+				GateOp start;
+				start.kind = GateOp::Window;
+				start.nbGates = 0;
+				for (const auto &op : window)
+					start.nbGates += op.nbGates;
+				start.nbOps = window.size();
+				start.blockQubits = in_blockQubits;
+				result.push_back(start);
+			}
+			result.insert(result.end(), window.begin(), window.end());
+			result.insert(result.end(), deferred.begin(), deferred.end());
+			window.clear();
+			deferred.clear();
+			deferredMask = 0;
+		};
+
+		auto qubitMask = [](const GateOp &in_op) {
+			uint64_t mask = 0;
+			for (const auto &qubit : in_op.qubits)
+				mask |= 1ULL << qubit;
+			return mask;
+		};
+
+		// Number of the next ops, from in_ops[in_first], acting on qubit in_qubit of in_ops
+		auto uses = [&](size_t in_first, int in_qubit) {
+			int count = 0;
+			for (size_t i = in_first; i < std::min(in_ops.size(), in_first + LOOKAHEAD); ++i)
+				if (std::find(in_ops[i].qubits.begin(), in_ops[i].qubits.end(), in_qubit) != in_ops[i].qubits.end())
+					++count;
+			return count;
+		};
+
+		for (size_t i = 0; i < in_ops.size(); ++i) {
+
+			GateOp op = in_ops[i].relabeled(positions);
+
+			for (const auto &qubit : in_ops[i].qubits) {
+				if (positions[qubit] < in_blockQubits)
+					continue;
+				const int gain = uses(i, qubit);
+				int victim = -1;
+				int victimUses = 0;
+				for (int low = 0; low < in_blockQubits; ++low) {
+					if ((qubitMask(op) >> low) & 1ULL)
+						continue;
+					const int lowUses = uses(i, holders[low]);
+					if (victim < 0 || lowUses < victimUses) {
+						victim = low;
+						victimUses = lowUses;
+					}
+				}
+				if (victim < 0 || gain - victimUses < MIN_GAIN)
+					continue;
+				const int high = positions[qubit];
+				deferred.push_back(GateOp::lower(GateOp::Swap, {victim, high}));
+				deferredMask |= (1ULL << victim) | (1ULL << high);
+				std::swap(holders[victim], holders[high]);
+				positions[holders[victim]] = victim;
+				positions[holders[high]] = high;
+				op = in_ops[i].relabeled(positions);
+			}
+
+			const uint64_t mask = qubitMask(op);
+			if ((mask & ~lowMask) != 0) {
+				deferred.push_back(op);
+				deferredMask |= mask;
+			} else {
+				if ((mask & deferredMask) != 0)
+					closeWindow();
+				window.push_back(op);
+			}
+		}
+
+		// Swaps putting every qubit back in place, from the lowest one
+		for (int qubit = 0; qubit < in_nbQubits; ++qubit) {
+			const int position = positions[qubit];
+			if (position == qubit)
+				continue;
+			deferred.push_back(GateOp::lower(GateOp::Swap, {qubit, position}));
+			const int displaced = holders[qubit];
+			holders[position] = displaced;
+			positions[displaced] = position;
+			holders[qubit] = qubit;
+			positions[qubit] = qubit;
+		}
+
+		closeWindow();
+
+		return result;
+
+	}
+
+	std::vector<GateOp> groupLayers(const std::vector<GateOp> &in_ops, int in_nbQubits, int in_maxQubits) {
+
+		if (in_nbQubits <= LAYER_TILE_QUBITS || in_maxQubits < 1)
+			return in_ops;
+
+		std::vector<GateOp> result, layer;
+		uint64_t layerMask = 0;
+
+		auto closeLayer = [&]() {
+			if (layer.size() > 1) {
+				GateOp start;
+				start.kind = GateOp::Layer;
+				start.nbGates = 0;
+				for (const auto &op : layer)
+					start.nbGates += op.nbGates;
+				start.nbOps = layer.size();
+				for (int qubit = 0; qubit < in_nbQubits; ++qubit)
+					if ((layerMask >> qubit) & 1ULL)
+						start.qubits.push_back(qubit);
+				result.push_back(start);
+			}
+			result.insert(result.end(), layer.begin(), layer.end());
+			layer.clear();
+			layerMask = 0;
+		};
+
+		for (size_t i = 0; i < in_ops.size(); ++i) {
+
+			const auto &op = in_ops[i];
+
+			if (op.kind == GateOp::Window) {
+				closeLayer();
+				result.insert(result.end(), in_ops.begin() + i, in_ops.begin() + i + 1 + op.nbOps);
+				i += op.nbOps;
+				continue;
+			}
+
+			uint64_t opMask = 0;
+			for (const auto &qubit : op.qubits)
+				opMask |= 1ULL << qubit;
+			if (__builtin_popcountll(layerMask | opMask) > in_maxQubits)
+				closeLayer();
+			layer.push_back(op);
+			layerMask |= opMask;
+		}
+
+		closeLayer();
+
+		return result;
+
+	}
+
+	void applyGateOp(Qureg &io_qreg, const GateOp &in_op) {
+
+		applyGate(io_qreg, in_op.kind, in_op.qubits.data(), in_op.qubits.size(), in_op.params.data(),
+				in_op.matrix.data(), in_op.phases.data(), in_op.phases.size(), in_op.permutations.data(), in_op.permutations.size());
+
+	}
+
+	GateTape::GateTape(const std::vector<GateOp> &in_ops) {
+
+		entries.reserve(in_ops.size());
+
+		for (const auto &op : in_ops) {
+			entries.push_back({op.kind, (int) op.qubits.size(), op.nbGates, qubits.size(), params.size(), matrices.size(), phases.size(), op.phases.size(),
+					permutations.size(), op.permutations.size(), op.nbOps, op.blockQubits});
+			qubits.insert(qubits.end(), op.qubits.begin(), op.qubits.end());
+			params.insert(params.end(), op.params.begin(), op.params.end());
+			// Gates with a dedicated QuEST function also need their matrix, for the low qubit kernels.
+			matrices.insert(matrices.end(), op.matrix.begin(), op.matrix.end());
+			phases.insert(phases.end(), op.phases.begin(), op.phases.end());
+			permutations.insert(permutations.end(), op.permutations.begin(), op.permutations.end());
+		}
+
+	}
+
+	void GateTape::apply(Qureg &io_qreg) const {
+
+		for (size_t e = 0; e < entries.size(); ++e) {
+			const auto &entry = entries[e];
+			if (entry.kind == GateOp::Window) {
+				applyWindow(io_qreg, e + 1, entry.nbOps, entry.blockQubits);
+				e += entry.nbOps;
+				continue;
+			}
+			if (entry.kind == GateOp::Layer) {
+				applyLayer(io_qreg, e + 1, entry.nbOps, qubits.data() + entry.qubitOffset, entry.nbQubits);
+				e += entry.nbOps;
+				continue;
+			}
+			applyGate(io_qreg, entry.kind, qubits.data() + entry.qubitOffset, entry.nbQubits, params.data() + entry.paramOffset,
+					matrices.data() + entry.matrixOffset, phases.data() + entry.phaseOffset, entry.nbPhases,
+					permutations.data() + entry.permutationOffset, entry.nbPermutations);
+		}
+
+	}
+
+	void GateTape::applyWindow(Qureg &io_qreg, size_t in_first, size_t in_nbEntries, int in_blockQubits) const {
+
+		const long long blockSize = 1LL << in_blockQubits;
+		const long long nbBlocks = io_qreg.numAmpsTotal / blockSize;
+
+		// The kernels parallelize over the amplitudes of a block, which is left to the enclosing loop here
+		#pragma omp parallel for schedule(static)
+		for (long long b = 0; b < nbBlocks; ++b) {
+
+			Qureg block = io_qreg;
+			block.stateVec.real += b * blockSize;
+			block.stateVec.imag += b * blockSize;
+			block.numQubitsRepresented = in_blockQubits;
+			block.numQubitsInStateVec = in_blockQubits;
+			block.numAmpsPerChunk = blockSize;
+			block.numAmpsTotal = blockSize;
+
+			for (size_t e = in_first; e < in_first + in_nbEntries; ++e) {
+				const auto &entry = entries[e];
+				applyBlockGate(block, entry.kind, qubits.data() + entry.qubitOffset, entry.nbQubits, matrices.data() + entry.matrixOffset,
+						phases.data() + entry.phaseOffset, entry.nbPhases, permutations.data() + entry.permutationOffset, entry.nbPermutations);
+			}
+		}
+
+	}
+
+	void GateTape::applyLayer(Qureg &io_qreg, size_t in_first, size_t in_nbEntries, const int *in_layerQubits, int in_nbLayerQubits) const {
+
+		const int nbQubits = io_qreg.numQubitsInStateVec;
+
+		// Qubits of the tiles: those of the layer, and the lowest other ones so that the tiles are gathered in contiguous runs
+		uint64_t tileMask = 0;
+		for (int q = 0; q < in_nbLayerQubits; ++q)
+			tileMask |= 1ULL << in_layerQubits[q];
+		for (int qubit = 0; qubit < nbQubits && __builtin_popcountll(tileMask) < LAYER_TILE_QUBITS; ++qubit)
+			tileMask |= 1ULL << qubit;
+
+		// Position in the tiles of each qubit, and offset in the state of each amplitude of a tile
+		const int tileQubits = __builtin_popcountll(tileMask);
+		const long long tileSize = 1LL << tileQubits;
+		std::vector<int> positions(64);
+		std::iota(positions.begin(), positions.end(), 0);
+		std::vector<int> qubitsOfTile;
+		for (int qubit = 0; qubit < nbQubits; ++qubit)
+			if ((tileMask >> qubit) & 1ULL) {
+				positions[qubit] = qubitsOfTile.size();
+				qubitsOfTile.push_back(qubit);
+			}
+		// The lowest qubits of the tiles are the lowest of the state: the tiles are made of runs of consecutive amplitudes
+		int runQubits = 0;
+		while (runQubits < tileQubits && qubitsOfTile[runQubits] == runQubits)
+			++runQubits;
+		const long long runSize = 1LL << runQubits;
+		std::vector<long long> offsets(tileSize >> runQubits);
+		for (long long r = 0; r < (long long) offsets.size(); ++r)
+			for (int t = runQubits; t < tileQubits; ++t)
+				offsets[r] |= ((r >> (t - runQubits)) & 1LL) << qubitsOfTile[t];
+
+		// The entries, on the qubits of the tiles, with what they need prepared once for all the tiles:
+		// the phase tables of the diagonal runs, and the amplitude offsets of the matrices of the other gates
+		std::vector<GateOp> local;
+		std::vector<kernels::PhaseTable> phaseTables(in_nbEntries);
+		std::vector<kernels::MatrixLayout> layouts(in_nbEntries);
+		size_t scratchSize = 0;
+		for (size_t e = in_first; e < in_first + in_nbEntries; ++e) {
+			const auto &entry = entries[e];
+			GateOp op;
+			op.kind = entry.kind;
+			op.qubits.assign(qubits.begin() + entry.qubitOffset, qubits.begin() + entry.qubitOffset + entry.nbQubits);
+			op.phases.assign(phases.begin() + entry.phaseOffset, phases.begin() + entry.phaseOffset + entry.nbPhases);
+			op.permutations.assign(permutations.begin() + entry.permutationOffset, permutations.begin() + entry.permutationOffset + entry.nbPermutations);
+			local.push_back(op.relabeled(positions));
+
+			const auto &tileOp = local.back();
+			const size_t o = e - in_first;
+			if (tileOp.kind == GateOp::Diagonal) {
+				phaseTables[o] = kernels::preparePhaseTerms(tileOp.phases.data(), tileOp.phases.size(), tileQubits);
+			} else if (!tileOp.isPermutation()) {
+				layouts[o] = kernels::prepareMatrix(tileOp.qubits.data(), tileOp.qubits.size());
+				scratchSize = std::max(scratchSize, layouts[o].offsets.size());
+			}
+		}
+
+		const long long nbTiles = io_qreg.numAmpsTotal / tileSize;
+
+		#pragma omp parallel
+		{
+			std::vector<qreal> real(tileSize), imag(tileSize);
+			std::vector<Amplitude> scratch(scratchSize);
+			Qureg tile = io_qreg;
+			tile.stateVec.real = real.data();
+			tile.stateVec.imag = imag.data();
+			tile.numQubitsRepresented = tileQubits;
+			tile.numQubitsInStateVec = tileQubits;
+			tile.numAmpsPerChunk = tileSize;
+			tile.numAmpsTotal = tileSize;
+
+			#pragma omp for schedule(static)
+			for (long long t = 0; t < nbTiles; ++t) {
+
+				// First amplitude of the tile: t with a zero bit inserted at each qubit of the tiles
+				long long base = t;
+				for (const auto &qubit : qubitsOfTile)
+					base = ((base >> qubit) << (qubit + 1)) | (base & ((1LL << qubit) - 1));
+
+				for (size_t r = 0; r < offsets.size(); ++r) {
+					std::copy_n(io_qreg.stateVec.real + (base | offsets[r]), runSize, real.data() + r * runSize);
+					std::copy_n(io_qreg.stateVec.imag + (base | offsets[r]), runSize, imag.data() + r * runSize);
+				}
+
+				for (size_t o = 0; o < local.size(); ++o) {
+					const auto &op = local[o];
+					const Amplitude *matrix = matrices.data() + entries[in_first + o].matrixOffset;
+					if (op.kind == GateOp::Diagonal)
+						kernels::applyPhaseTable(tile, phaseTables[o]);
+					else if (op.isPermutation())
+						applyBlockGate(tile, op.kind, op.qubits.data(), op.qubits.size(), matrix,
+								nullptr, 0, op.permutations.data(), op.permutations.size());
+					else if (!applyLowGate(tile, op.kind, op.qubits.data(), op.qubits.size(), matrix))
+						kernels::applyMatrix(tile, layouts[o], matrix, scratch.data());
+				}
+
+				for (size_t r = 0; r < offsets.size(); ++r) {
+					std::copy_n(real.data() + r * runSize, runSize, io_qreg.stateVec.real + (base | offsets[r]));
+					std::copy_n(imag.data() + r * runSize, runSize, io_qreg.stateVec.imag + (base | offsets[r]));
+				}
+			}
+		}
+
+	}
+
+	void GateTape::patch(size_t in_entry, const GateOp &in_op) {
+
+		const auto &entry = entries[in_entry];
+		assert(entry.kind == in_op.kind && entry.nbPhases == in_op.phases.size());
+
+		std::copy(in_op.params.begin(), in_op.params.end(), params.begin() + entry.paramOffset);
+		std::copy(in_op.matrix.begin(), in_op.matrix.end(), matrices.begin() + entry.matrixOffset);
+		std::copy(in_op.phases.begin(), in_op.phases.end(), phases.begin() + entry.phaseOffset);
+
+	}
+
+	std::pair<int, int> GateTape::count(GateOp::Kind in_kind) const {
+
+		std::pair<int, int> result(0, 0);
+		for (const auto &entry : entries)
+			if (entry.kind == in_kind) {
+				++result.first;
+				result.second += entry.nbGates;
+			}
+
+		return result;
+
+	}
+
+} // namespace quacc
@@ -0,0 +1,172 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#ifndef QUACC_GATE_OPS_HPP_
+#define QUACC_GATE_OPS_HPP_
+
+#include <complex>
+#include <utility>
+#include <vector>
+
+#include "../../../../quacc/visitors/quest-default/QuEST/include/QuEST.h"
+#include "StateVectorKernels.hpp"
+
+namespace quacc {
+
+	// A visited gate lowered to its matrix, queued until the state is needed.
+	struct GateOp {
+
+		// Gate the op was lowered from, Fused once other gates have been merged into it,
+		// Diagonal for a run of diagonal gates accumulated into phases, Permutation for a run of
+		// permutation gates composed into one.
+		// A Window op has no effect of its own, it starts a window of ops applied block by block (see scheduleCacheBlocks()),
+		// nor has a Layer op, which starts a layer of ops applied in a single sweep over its qubits (see groupLayers()).
+		enum Kind { H, X, Y, Z, Rx, Ry, Rz, U, CNOT, CZ, CPhase, Swap, Fused, Diagonal, Permutation, Window, Layer };
+
+		Kind kind;
+		std::vector<int> qubits;
+		std::vector<double> params;
+		// Row-major 2^k x 2^k matrix, qubits[0] being the least significant bit of its indices.
+		std::vector<std::complex<double>> matrix;
+		// Phases of a Diagonal op, which has no matrix.
+		std::vector<kernels::PhaseTerm> phases;
+		// Permutations of a Permutation op, which has no matrix either, in the order they apply.
+		std::vector<kernels::BitPermutation> permutations;
+		// Number of circuit gates this op stands for.
+		int nbGates = 1;
+		// Number of ops following a Window or Layer op that are in its window or layer,
+		// and the qubits of the blocks the ops of a window are applied on.
+		int nbOps = 0;
+		int blockQubits = 0;
+		// Indices of the lowered ops merged into this one, tracked for parametric kernels (see ParametricKernel).
+		std::vector<size_t> sources;
+
+		bool isDiagonal() const { return kind == Z || kind == Rz || kind == CZ || kind == CPhase || kind == Diagonal; }
+		bool isPermutation() const { return kind == X || kind == CNOT || kind == Swap || kind == Permutation; }
+
+		// The inverse op, applied through its matrix (or its negated phases, or its permutations in reverse order).
+		GateOp adjoint() const;
+		// The op acting on qubits in_positions[q] instead of its qubits q (the matrix does not depend on them).
+		GateOp relabeled(const std::vector<int> &in_positions) const;
+		// Derivative of the matrix of a lowered gate with respect to params[in_param] (not unitary).
+		std::vector<std::complex<double>> derivative(size_t in_param) const;
+
+		static GateOp lower(Kind in_kind, const std::vector<int> &in_qubits, const std::vector<double> &in_params = {});
+	};
+
+	// Collects runs of diagonal gates (Z, Rz, CZ, CPhase) into Diagonal ops applied in a single pass.
+	// A diagonal gate joins the open run if no other gate since then acted on its qubits. Runs on
+	// fewer than in_minQubits qubits, or of a single gate, are left as separate gates.
+	std::vector<GateOp> accumulateDiagonalGates(const std::vector<GateOp> &in_ops, int in_minQubits);
+
+	// Composes runs of permutation gates (X, CNOT, Swap) into Permutation ops, each applied in a single
+	// in-place pass that moves every amplitude once. Toffoli and multi-controlled X gates are no gates of their own
+	// to the visitors: XACC decomposes them into H, T, Tdg and CNOT first, so only their CNOTs are composed here. Runs are collected as accumulateDiagonalGates() collects diagonal
+	// gates; those on fewer than in_minQubits qubits, or of a single gate, are left as separate gates.
+	std::vector<GateOp> composePermutations(const std::vector<GateOp> &in_ops, int in_minQubits);
+
+	// Greedily packs consecutive gates into blocks acting on at most in_maxQubits qubits:
+	// each gate joins the latest block touching one of its qubits if the block stays small enough.
+	// With in_maxQubits = 1 only runs of single-qubit gates on the same qubit are merged.
+	// Diagonal and Permutation ops are kept as they are.
+	std::vector<GateOp> fuseGates(const std::vector<GateOp> &in_ops, int in_maxQubits);
+
+	// Groups runs of ops confined to the qubits below in_blockQubits into windows: a window is applied block by block,
+	// every op of the window being applied to a block of 2^in_blockQubits amplitudes while it is in cache, so that the
+	// state is streamed from memory once per window instead of once per op. An op on higher qubits is deferred past the
+	// following ops on other qubits, and when one of its high qubits is used by enough of the next ops, that qubit is
+	// first exchanged with a little used low qubit by a Swap, all such swaps being undone at the end.
+	// A window of more than one op is returned as a Window op followed by its ops.
+	std::vector<GateOp> scheduleCacheBlocks(const std::vector<GateOp> &in_ops, int in_nbQubits, int in_blockQubits);
+
+	// Number of qubits of the tiles a layer is applied on, see groupLayers(): 64 KB of amplitudes, kept in cache.
+	// The tiles do not grow with the layer, which bounds the layers to fewer qubits than the register.
+	constexpr int LAYER_TILE_QUBITS = 12;
+
+	// Groups runs of consecutive ops acting together on at most in_maxQubits qubits into layers, e.g. a moment of gates
+	// on disjoint qubits. A layer is applied in a single sweep over the state: the amplitudes are gathered in tiles over
+	// its qubits and the lowest other ones (LAYER_TILE_QUBITS qubits in all), every op of the layer is applied to a tile
+	// while it is in cache, and the tile is written back. The ops of the windows of scheduleCacheBlocks() are left as they
+	// are. A layer of more than one op is returned as a Layer op, on the qubits of the layer, followed by its ops.
+	std::vector<GateOp> groupLayers(const std::vector<GateOp> &in_ops, int in_nbQubits, int in_maxQubits);
+
+	// Applies in_op to in_qreg through QuEST, with the dedicated QuEST function for unfused gates.
+	// Permutation gates are applied as in-place exchanges of amplitudes.
+	void applyGateOp(Qureg &io_qreg, const GateOp &in_op);
+
+	// A sequence of ops compiled once into flat arrays, so that it can be replayed
+	// without walking the IR nor running the fusion passes again.
+	class GateTape {
+
+		public:
+
+		  GateTape() = default;
+		  explicit GateTape(const std::vector<GateOp> &in_ops);
+
+		  void apply(Qureg &io_qreg) const;
+		  // Overwrites the values of entry in_entry with those of in_op, of the same kind and shape.
+		  void patch(size_t in_entry, const GateOp &in_op);
+
+		  size_t size() const { return entries.size(); }
+		  // Number of ops of kind in_kind on the tape, and number of circuit gates they stand for.
+		  std::pair<int, int> count(GateOp::Kind in_kind) const;
+
+		private:
+
+		  struct Entry {
+			  GateOp::Kind kind;
+			  int nbQubits;
+			  int nbGates;
+			  size_t qubitOffset;
+			  size_t paramOffset;
+			  size_t matrixOffset;
+			  size_t phaseOffset;
+			  size_t nbPhases;
+			  size_t permutationOffset;
+			  size_t nbPermutations;
+			  int nbOps;
+			  int blockQubits;
+		  };
+
+		  // Applies the in_nbEntries entries from in_first block by block
+		  void applyWindow(Qureg &io_qreg, size_t in_first, size_t in_nbEntries, int in_blockQubits) const;
+		  // Applies the in_nbEntries entries from in_first tile by tile, the tiles spanning the in_nbLayerQubits in_layerQubits
+		  void applyLayer(Qureg &io_qreg, size_t in_first, size_t in_nbEntries, const int *in_layerQubits, int in_nbLayerQubits) const;
+
+		  std::vector<Entry> entries;
+		  std::vector<int> qubits;
+		  std::vector<double> params;
+		  std::vector<std::complex<double>> matrices;
+		  std::vector<kernels::PhaseTerm> phases;
+		  std::vector<kernels::BitPermutation> permutations;
+	};
+
+} // namespace quacc
+
+#endif /* QUACC_GATE_OPS_HPP_ */
@@ -0,0 +1,128 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#include "GateTapeCache.hpp"
+
+namespace quacc {
+
+	GateTapeCache& GateTapeCache::instance() {
+		static GateTapeCache cache;
+		return cache;
+	}
+
+	std::shared_ptr<const CompiledKernel> GateTapeCache::find(const TapeKey& in_key) {
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		const auto kernel = kernels.find(in_key);
+		if (kernel == kernels.end()) {
+			++nbMisses;
+			return nullptr;
+		}
+
+		++nbHits;
+		return kernel->second;
+
+	}
+
+	void GateTapeCache::insert(const TapeKey& in_key, std::shared_ptr<const CompiledKernel> in_kernel) {
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (capacity == 0)
+			return;
+
+		if (kernels.find(in_key) == kernels.end())
+			insertionOrder.push_back(in_key);
+		kernels[in_key] = in_kernel;
+
+		evict();
+
+	}
+
+	bool GateTapeCache::findParametric(const TapeKey& in_key, std::shared_ptr<ParametricKernel> &out_kernel) {
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		const auto kernel = parametricKernels.find(in_key);
+		if (kernel == parametricKernels.end()) {
+			++nbMisses;
+			return false;
+		}
+
+		++nbHits;
+		out_kernel = kernel->second;
+		return true;
+
+	}
+
+	void GateTapeCache::insertParametric(const TapeKey& in_key, std::shared_ptr<ParametricKernel> in_kernel) {
+
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (capacity == 0)
+			return;
+
+		if (parametricKernels.find(in_key) == parametricKernels.end())
+			insertionOrder.push_back(in_key);
+		parametricKernels[in_key] = in_kernel;
+
+		evict();
+
+	}
+
+	void GateTapeCache::setCapacity(size_t in_capacity) {
+
+		std::lock_guard<std::mutex> lock(mutex);
+		capacity = in_capacity;
+		evict();
+
+	}
+
+	void GateTapeCache::evict() {
+
+		while (kernels.size() + parametricKernels.size() > capacity) {
+			kernels.erase(insertionOrder.front());
+			parametricKernels.erase(insertionOrder.front());
+			insertionOrder.pop_front();
+		}
+
+	}
+
+	int GateTapeCache::hits() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return nbHits;
+	}
+
+	int GateTapeCache::misses() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return nbMisses;
+	}
+
+} // namespace quacc
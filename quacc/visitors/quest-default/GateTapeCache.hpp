@@ -0,0 +1,136 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#ifndef QUACC_GATE_TAPE_CACHE_HPP_
+#define QUACC_GATE_TAPE_CACHE_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include "GateOps.hpp"
+#include "ParametricKernel.hpp"
+
+namespace quacc {
+
+	// A kernel lowered to the ops applied to the register, and the qubits measured at its end.
+	struct CompiledKernel {
+		GateTape tape;
+		std::set<size_t> measuredBits;
+	};
+
+	// Structure of a kernel (gate names, qubits, parameter values or expressions) and of the options shaping its tape,
+	// as a sequence of words hashed as they are added. Two kernels only share a tape if their words are equal, not merely
+	// their hashes. A key is cleared and refilled for each lookup, so that its words are not reallocated every time.
+	class TapeKey {
+
+		public:
+
+		  TapeKey() { clear(); }
+
+		  void clear() { words.clear(); hash = 0xcbf29ce484222325ULL; }
+
+		  void add(uint64_t in_word) {
+			  words.push_back(in_word);
+			  hash ^= in_word + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+		  }
+
+		  // in_size bytes from in_data, with their count so that consecutive byte sequences do not run into each other
+		  void add(const void *in_data, size_t in_size) {
+			  add(in_size);
+			  const char *data = static_cast<const char*>(in_data);
+			  for (size_t offset = 0; offset < in_size; offset += sizeof(uint64_t)) {
+				  uint64_t word = 0;
+				  std::memcpy(&word, data + offset, std::min(sizeof(uint64_t), in_size - offset));
+				  add(word);
+			  }
+		  }
+
+		  size_t hashValue() const { return hash; }
+		  bool operator==(const TapeKey &in_key) const { return hash == in_key.hash && words == in_key.words; }
+
+		private:
+
+		  std::vector<uint64_t> words;
+		  uint64_t hash;
+	};
+
+	struct TapeKeyHash {
+		size_t operator()(const TapeKey &in_key) const { return in_key.hashValue(); }
+	};
+
+	// Compiled kernels keyed by their structure (and by the options shaping the tape),
+	// so that re-executing the same circuit replays its tape instead of walking the IR again.
+	// The oldest kernels are evicted once the cache is full.
+	// Parametric kernels are patched in place when bound, so they are not shared between concurrent executions.
+	class GateTapeCache {
+
+		public:
+
+		  static GateTapeCache& instance();
+
+		  // The kernel compiled under in_key, or nullptr if there is none.
+		  std::shared_ptr<const CompiledKernel> find(const TapeKey& in_key);
+		  void insert(const TapeKey& in_key, std::shared_ptr<const CompiledKernel> in_kernel);
+
+		  // Kernels with free variables, compiled for parameter rebinding. A null kernel records
+		  // that the kernel could not be compiled, so that it is not attempted again.
+		  bool findParametric(const TapeKey& in_key, std::shared_ptr<ParametricKernel> &out_kernel);
+		  void insertParametric(const TapeKey& in_key, std::shared_ptr<ParametricKernel> in_kernel);
+
+		  // Number of kernels kept, the oldest ones above it are evicted.
+		  void setCapacity(size_t in_capacity);
+
+		  int hits() const;
+		  int misses() const;
+
+		private:
+
+		  GateTapeCache() = default;
+
+		  void evict();
+
+		  mutable std::mutex mutex;
+		  std::unordered_map<TapeKey, std::shared_ptr<const CompiledKernel>, TapeKeyHash> kernels;
+		  std::unordered_map<TapeKey, std::shared_ptr<ParametricKernel>, TapeKeyHash> parametricKernels;
+		  std::deque<TapeKey> insertionOrder;
+		  size_t capacity = 64;
+		  int nbHits = 0;
+		  int nbMisses = 0;
+	};
+
+} // namespace quacc
+
+#endif /* QUACC_GATE_TAPE_CACHE_HPP_ */
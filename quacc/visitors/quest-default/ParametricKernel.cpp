@@ -0,0 +1,101 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#include <numeric>
+
+#include "ParametricKernel.hpp"
+
+namespace quacc {
+
+	ParametricKernel::ParametricKernel(const std::vector<GateOp> &in_lowered, const std::vector<AffineParameter> &in_parameters,
+			const std::vector<GateOp> &in_ops, size_t in_nbVariables, const std::set<size_t> &in_measuredBits)
+		: lowered(in_lowered), affineParameters(in_parameters), ops(in_ops), dependents(in_lowered.size()),
+		  variableCount(in_nbVariables), measured(in_measuredBits), tape(in_ops) {
+
+		for (size_t o = 0; o < ops.size(); ++o)
+			for (const auto &source : ops[o].sources)
+				dependents[source].push_back(o);
+
+	}
+
+	const GateTape& ParametricKernel::bind(const std::vector<double> &in_variables, size_t in_shifted, double in_shift) {
+
+		std::set<size_t> changedOps;
+
+		for (size_t i = 0; i < affineParameters.size(); ++i) {
+			const auto &parameter = affineParameters[i];
+			double value = parameter.offset + (i == in_shifted ? in_shift : 0.0);
+			for (const auto &coefficient : parameter.coefficients)
+				value += coefficient.second * in_variables[coefficient.first];
+
+			auto &op = lowered[parameter.op];
+			if (op.params[parameter.param] != value) {
+				op.params[parameter.param] = value;
+				changedOps.insert(parameter.op);
+			}
+		}
+
+		std::set<size_t> changedEntries;
+		for (const auto &o : changedOps) {
+			auto relowered = GateOp::lower(lowered[o].kind, lowered[o].qubits, lowered[o].params);
+			relowered.sources = lowered[o].sources;
+			lowered[o] = relowered;
+			changedEntries.insert(dependents[o].begin(), dependents[o].end());
+		}
+
+		for (const auto &e : changedEntries) {
+
+			std::vector<GateOp> merged;
+			for (const auto &source : ops[e].sources)
+				merged.push_back(lowered[source]);
+
+			// Running the same pass on the merged ops alone merges them the same way again.
+			GateOp rebuilt;
+			if (ops[e].kind == GateOp::Diagonal)
+				rebuilt = accumulateDiagonalGates(merged, 0).front();
+			else if (ops[e].kind == GateOp::Fused)
+				rebuilt = fuseGates(merged, ops[e].qubits.size()).front();
+			else
+				rebuilt = merged.front();
+
+			// Back on the qubits the op was moved to by scheduleCacheBlocks(), if any
+			std::vector<int> positions(64);
+			std::iota(positions.begin(), positions.end(), 0);
+			for (size_t q = 0; q < rebuilt.qubits.size(); ++q)
+				positions[rebuilt.qubits[q]] = ops[e].qubits[q];
+			ops[e] = rebuilt.relabeled(positions);
+
+			tape.patch(e, ops[e]);
+		}
+
+		return tape;
+
+	}
+
+} // namespace quacc
@@ -0,0 +1,90 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#ifndef QUACC_PARAMETRIC_KERNEL_HPP_
+#define QUACC_PARAMETRIC_KERNEL_HPP_
+
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "GateOps.hpp"
+
+namespace quacc {
+
+	// Parameter in_param of lowered op in_op, as an affine function of the kernel variables.
+	struct AffineParameter {
+		size_t op;
+		size_t param;
+		double offset;
+		// (variable index, coefficient) pairs
+		std::vector<std::pair<size_t, double>> coefficients;
+	};
+
+	// A kernel with free variables compiled once into a tape. Binding new variable values
+	// re-lowers the gates depending on them and patches only the tape entries they were merged into,
+	// the fusion of the ops depending on the qubits they act on and not on the gate parameters.
+	class ParametricKernel {
+
+		public:
+
+		  // in_lowered: ops of the kernel lowered with all variables at 0, in_lowered[i].sources being {i},
+		  // in_ops: the ops the passes turned them into, applied by the tape.
+		  ParametricKernel(const std::vector<GateOp> &in_lowered, const std::vector<AffineParameter> &in_parameters,
+				  const std::vector<GateOp> &in_ops, size_t in_nbVariables, const std::set<size_t> &in_measuredBits);
+
+		  // The tape of the kernel with its variables set to in_variables, and gate parameter
+		  // in_shifted (an index in parameters()) moved by in_shift, as the parameter-shift rule needs.
+		  const GateTape& bind(const std::vector<double> &in_variables, size_t in_shifted = NO_SHIFT, double in_shift = 0.0);
+
+		  static constexpr size_t NO_SHIFT = static_cast<size_t>(-1);
+
+		  // The gates of the kernel, lowered with the variables last bound
+		  const std::vector<GateOp>& loweredOps() const { return lowered; }
+		  // The gate parameters depending on the variables
+		  const std::vector<AffineParameter>& parameters() const { return affineParameters; }
+
+		  size_t nbVariables() const { return variableCount; }
+		  const std::set<size_t>& measuredBits() const { return measured; }
+
+		private:
+
+		  std::vector<GateOp> lowered;
+		  std::vector<AffineParameter> affineParameters;
+		  std::vector<GateOp> ops;
+		  // Per lowered op, the ops (i.e. tape entries) it was merged into
+		  std::vector<std::vector<size_t>> dependents;
+		  size_t variableCount;
+		  std::set<size_t> measured;
+		  GateTape tape;
+	};
+
+} // namespace quacc
+
+#endif /* QUACC_PARAMETRIC_KERNEL_HPP_ */
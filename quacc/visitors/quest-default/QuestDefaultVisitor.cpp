@@ -31,12 +31,22 @@
  *
  **********************************************************************************/
 #include "AllGateVisitor.hpp"
+#include <algorithm>
 #include <complex>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <cassert>
+#include <numeric>
+#include <unistd.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 #include "Eigen/Dense"
 #include "QuestDefaultVisitor.hpp"
+#include "StateVectorKernels.hpp"
+#include "QuregPool.hpp"
+#include "GateTapeCache.hpp"
 
 namespace quacc {
 
@@ -55,8 +65,206 @@ namespace quacc {
 	  return 0.0;
 	}
 
+	// Recovers the Pauli string measured by an observed sub-circuit, i.e. Measure gates preceded by
+	// H (X basis) or Rx(+-pi/2) (Y basis) changes of basis, on the register qubits in_registerQubits maps the
+	// buffer ones to. Returns false for any other circuit.
+	bool toPauliMasks(std::shared_ptr<CompositeInstruction> in_function, const std::vector<size_t>& in_registerQubits,
+			uint64_t& out_xMask, uint64_t& out_zMask, double& out_sign){
+
+		std::map<size_t, std::string> basisChanges;
+		std::set<size_t> measureBitIdxs;
+		out_sign = 1.0;
+
+		InstructionIterator it(in_function);
+		while (it.hasNext())
+		{
+			auto nextInst = it.next();
+			if (!nextInst->isEnabled() || nextInst->isComposite())
+				continue;
+
+			const size_t bit = in_registerQubits[nextInst->bits()[0]];
+			if (bit >= 64 || measureBitIdxs.count(bit))
+				return false;
+
+			if (nextInst->name() == "Measure")
+			{
+				measureBitIdxs.insert(bit);
+				continue;
+			}
+
+			if (basisChanges.count(bit))
+				return false;
+
+			if (nextInst->name() == "H")
+			{
+				basisChanges[bit] = "X";
+			}
+			else if (nextInst->name() == "Rx")
+			{
+				// Rx(theta)^dag Z Rx(theta) = cos(theta) Z + sin(theta) Y
+				const double theta = InstructionParameterToDouble(nextInst->getParameter(0));
+				if (std::abs(std::abs(theta) - M_PI_2) > 1e-12)
+					return false;
+				basisChanges[bit] = theta > 0 ? "Y" : "-Y";
+			}
+			else
+			{
+				return false;
+			}
+		}
+
+		out_xMask = 0;
+		out_zMask = 0;
+		for (const auto& bit : measureBitIdxs)
+		{
+			const std::string basis = basisChanges.count(bit) ? basisChanges[bit] : "Z";
+			if (basis != "Z")
+				out_xMask |= 1ULL << bit;
+			if (basis != "X")
+				out_zMask |= 1ULL << bit;
+			if (basis == "-Y")
+				out_sign = -out_sign;
+		}
+
+		return true;
+
+	}
+
+	// Splits observable into its Pauli strings and their (real) coefficients, returning the constant term.
+	double toPauliTerms(xacc::quantum::PauliOperator& observable, std::vector<kernels::PauliString>& out_terms, std::vector<double>& out_coefficients){
+
+		double constant = 0.0;
+
+		auto terms = observable.getTerms();
+		for(auto& term : terms){
+
+			const double coefficient = std::real(term.second.coeff());
+			if(term.second.ops().empty()){
+				constant += coefficient;
+				continue;
+			}
+
+			kernels::PauliString pauliTerm{0, 0};
+			for(const auto& op : term.second.ops()){
+				if(op.first >= 64)
+					xacc::error("QuestDefaultVisitor: Pauli term on qubit " + std::to_string(op.first) + " is not supported");
+				if(op.second == "X" || op.second == "Y")
+					pauliTerm.xMask |= 1ULL << op.first;
+				if(op.second == "Z" || op.second == "Y")
+					pauliTerm.zMask |= 1ULL << op.first;
+			}
+
+			out_terms.push_back(pauliTerm);
+			out_coefficients.push_back(coefficient);
+		}
+
+		return constant;
+
+	}
+
+	// Structure of the enabled gates of in_kernel (names, qubits and parameter values), added to io_key once cleared.
+	// Returns false if some parameter is not bound to a value, unless in_symbolic is set
+	// in which case the expression of the parameter is added instead.
+	bool structuralKey(std::shared_ptr<CompositeInstruction> in_kernel, TapeKey& io_key, bool in_symbolic = false){
+
+		// Tagged, so that parametric kernels never collide with the bound ones
+		io_key.clear();
+		io_key.add(in_symbolic ? 'p' : 'b');
+
+		InstructionIterator it(in_kernel);
+		while (it.hasNext())
+		{
+			auto nextInst = it.next();
+			if (!nextInst->isEnabled() || nextInst->isComposite())
+				continue;
+
+			const std::string name = nextInst->name();
+			io_key.add(name.data(), name.size());
+			const auto bits = nextInst->bits();
+			io_key.add(bits.size());
+			for(const auto& bit : bits)
+				io_key.add(bit);
+			for(const auto& parameter : nextInst->getParameters()){
+				if(parameter.which() != 0 && parameter.which() != 1){
+					if(!in_symbolic)
+						return false;
+					const std::string expression = parameter.toString();
+					io_key.add('e');
+					io_key.add(expression.data(), expression.size());
+					continue;
+				}
+				const double value = ipToDouble(parameter);
+				uint64_t word;
+				std::memcpy(&word, &value, sizeof(word));
+				io_key.add('v');
+				io_key.add(word);
+			}
+		}
+
+		return true;
+
+	}
+
+	// Physical index for each register qubit of in_kernel (see in_registerQubits), the qubits the most gates pair
+	// amplitudes on (i.e. their targets, but for diagonal gates and swaps) coming first, so that they get the low qubit
+	// kernels and the closest pairs.
+	// Returns false if too few gates would move below kernels::LOW_QUBITS to pay for putting the qubits back in order.
+	bool hotQubitOrder(std::shared_ptr<CompositeInstruction> in_kernel, const std::vector<size_t>& in_registerQubits, int in_nbQubits,
+			std::vector<int>& out_positions){
+
+		constexpr int MIN_GAIN = 8;
+		static const std::set<std::string> unpaired{"I", "Z", "Rz", "S", "Sdg", "T", "Tdg", "CZ", "CPhase", "Swap", "Measure"};
+
+		std::vector<int> targets;
+		InstructionIterator it(in_kernel);
+		while (it.hasNext())
+		{
+			auto nextInst = it.next();
+			if (!nextInst->isEnabled() || nextInst->isComposite() || nextInst->bits().empty() || unpaired.count(nextInst->name()))
+				continue;
+			const size_t bit = nextInst->bits().back();
+			if(bit >= in_registerQubits.size() || (int)in_registerQubits[bit] >= in_nbQubits)
+				return false;
+			const int target = in_registerQubits[bit];
+			targets.push_back(target);
+		}
+
+		std::vector<int> traffic(in_nbQubits, 0);
+		for(const auto& target : targets)
+			++traffic[target];
+
+		std::vector<int> qubits(in_nbQubits);
+		std::iota(qubits.begin(), qubits.end(), 0);
+		std::stable_sort(qubits.begin(), qubits.end(), [&](int in_a, int in_b){ return traffic[in_a] > traffic[in_b]; });
+
+		out_positions.assign(in_nbQubits, 0);
+		for(int position = 0; position < in_nbQubits; ++position)
+			out_positions[qubits[position]] = position;
+
+		int gain = 0;
+		for(const auto& target : targets)
+			gain += (target >= kernels::LOW_QUBITS) - (out_positions[target] >= kernels::LOW_QUBITS);
+
+		return gain >= MIN_GAIN;
+
+	}
+
+	// log2 of the number of amplitudes (16 bytes each) fitting in the L2 cache, 1 MB if it cannot be queried
+	int defaultCacheBlockQubits() {
+
+		long size = -1;
+#ifdef _SC_LEVEL2_CACHE_SIZE
+		size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+		if(size <= 0)
+			size = 1L << 20;
+
+		return 63 - __builtin_clzll(size / 16);
+
+	}
+
 	/// Constructor
-	QuestDefaultVisitor::QuestDefaultVisitor() : n_qbits(0), initialized(false) {}
+	QuestDefaultVisitor::QuestDefaultVisitor() : n_qbits(0), initialized(false), rng(std::random_device{}()) {}
 
 	void QuestDefaultVisitor::initialize(std::shared_ptr<AcceleratorBuffer> accbuffer_in) {
 
@@ -70,10 +278,21 @@ namespace quacc {
 
 	  buffer = accbuffer_in;
 	  n_qbits = accbuffer_in->size();
+	  // Only the active qubits are simulated, but on a register of the global one
+	  bufferQubits.clear();
+	  if(!activeQubits.empty() && !(xacc::optionExists("use_global_qreg") && xacc::getOption("use_global_qreg") == "true")){
+		  bufferQubits = activeQubits;
+		  n_qbits = bufferQubits.size();
+	  }
+	  activeQubits.clear();
 	  std::srand(std::time(0));
 	  cbits.resize(n_qbits);
 	  execTime = 0.0;
 
+	  n_shots = options.keyExists<int>("shots") ? options.get<int>("shots") : -1;
+	  if(options.keyExists<int>("seed"))
+		  rng.seed(options.get<int>("seed"));
+
 	  void *tempPointer;
 	  std::stringstream env_adress(xacc::getOption("global_env"));
 	  env_adress >> tempPointer;
@@ -99,13 +318,55 @@ namespace quacc {
 	  }else{
 
 		  global_qreg = false;
-		  qreg2 = createQureg(n_qbits, *env);
+		  if(options.keyExists<int>("qureg-pool-mb"))
+			  QuregPool::instance().setCapacity((size_t)options.get<int>("qureg-pool-mb") << 20);
+		  qreg2 = QuregPool::instance().acquire(n_qbits, *env);
 		  qreg = &qreg2;
 
 	  }
 
 	  //initZeroState(*qreg);
 
+	  gateFusion = !options.keyExists<bool>("gate-fusion") || options.get<bool>("gate-fusion");
+	  fusionMaxQubits = options.keyExists<int>("fusion-max-qubits") ? options.get<int>("fusion-max-qubits") : 2;
+	  if(fusionMaxQubits < 1 || fusionMaxQubits > 5)
+		  xacc::error("QuestDefaultVisitor: fusion-max-qubits must be between 1 and 5, got " + std::to_string(fusionMaxQubits));
+	  diagonalAccumulation = !options.keyExists<bool>("diagonal-accumulation") || options.get<bool>("diagonal-accumulation");
+	  permutationComposition = !options.keyExists<bool>("permutation-composition") || options.get<bool>("permutation-composition");
+	  swapRelabeling = !options.keyExists<bool>("swap-relabeling") || options.get<bool>("swap-relabeling");
+	  qubitOrdering = !options.keyExists<bool>("qubit-ordering") || options.get<bool>("qubit-ordering");
+	  cacheBlockQubits = options.keyExists<int>("cache-block-qubits") ? options.get<int>("cache-block-qubits") : defaultCacheBlockQubits();
+	  if(cacheBlockQubits != 0 && cacheBlockQubits < kernels::LOW_QUBITS)
+		  xacc::error("QuestDefaultVisitor: cache-block-qubits must be 0 (no cache blocking) or at least " + std::to_string(kernels::LOW_QUBITS) +
+				  ", got " + std::to_string(cacheBlockQubits));
+	  layerMaxQubits = options.keyExists<int>("layer-max-qubits") ? options.get<int>("layer-max-qubits") : 6;
+	  if(layerMaxQubits < 0 || layerMaxQubits > LAYER_TILE_QUBITS)
+		  xacc::error("QuestDefaultVisitor: layer-max-qubits must be between 0 (no layers) and " + std::to_string(LAYER_TILE_QUBITS) +
+				  ", got " + std::to_string(layerMaxQubits));
+	  if(options.keyExists<int>("tape-cache-size"))
+		  GateTapeCache::instance().setCapacity(options.get<int>("tape-cache-size"));
+	  pendingOps.clear();
+	  recording = false;
+	  recordedOps.clear();
+	  nbDiagonalRuns = 0;
+	  nbDiagonalGates = 0;
+	  nbFusedBlocks = 0;
+	  nbFusedGates = 0;
+	  nbPermutationRuns = 0;
+	  nbPermutationGates = 0;
+	  nbRelabeledSwaps = 0;
+	  nbReorderedQubits = 0;
+	  nbCacheWindows = 0;
+	  nbCacheWindowGates = 0;
+	  nbLayers = 0;
+	  nbLayerGates = 0;
+	  physicalQubits.resize(qreg->numQubitsInStateVec);
+	  std::iota(physicalQubits.begin(), physicalQubits.end(), 0);
+	  registerQubits.resize(std::max<size_t>(accbuffer_in->size(), qreg->numQubitsInStateVec));
+	  std::iota(registerQubits.begin(), registerQubits.end(), 0);
+	  for(size_t q = 0; q < bufferQubits.size(); ++q)
+		  registerQubits[bufferQubits[q]] = q;
+
 	  measured_bits.clear();
 	  initialized = true;
 
@@ -114,20 +375,515 @@ namespace quacc {
 
 	void QuestDefaultVisitor::finalize() {
 
+		if(initialized)
+			flushGates();
+
+		if(recording){
+			auto compiled = std::make_shared<CompiledKernel>();
+			compiled->tape = GateTape(recordedOps);
+			compiled->measuredBits = measured_bits;
+			GateTapeCache::instance().insert(recordedKey, compiled);
+			recording = false;
+			recordedOps.clear();
+		}
+
+		if(initialized && terminalMeasurements && !measured_bits.empty()){
+			if(n_shots > 0)
+				sampleMeasurements();
+			else
+				measureTerminal();
+		}
+
+		if(termQregAllocated){
+			QuregPool::instance().release(termQreg, *env);
+			termQregAllocated = false;
+		}
+
 		if(initialized && !global_qreg){
-			destroyQureg(qreg2, *env);
+			QuregPool::instance().release(qreg2, *env);
 			initialized = false;
 		}
 
+		executionInfo.insert("register-qubits", n_qbits);
+		executionInfo.insert("fusion-max-qubits", gateFusion ? fusionMaxQubits : 0);
+		executionInfo.insert("fused-blocks", nbFusedBlocks);
+		executionInfo.insert("diagonal-runs", nbDiagonalRuns);
+		executionInfo.insert("diagonal-gates", nbDiagonalGates);
+		executionInfo.insert("fused-gates", nbFusedGates);
+		executionInfo.insert("permutation-runs", nbPermutationRuns);
+		executionInfo.insert("permutation-gates", nbPermutationGates);
+		executionInfo.insert("relabeled-swaps", nbRelabeledSwaps);
+		executionInfo.insert("reordered-qubits", nbReorderedQubits);
+		executionInfo.insert("cache-block-qubits", cacheBlockQubits);
+		executionInfo.insert("cache-windows", nbCacheWindows);
+		executionInfo.insert("cache-window-gates", nbCacheWindowGates);
+		executionInfo.insert("layers", nbLayers);
+		executionInfo.insert("layer-gates", nbLayerGates);
+		executionInfo.insert("tape-cache-hits", GateTapeCache::instance().hits());
+		executionInfo.insert("tape-cache-misses", GateTapeCache::instance().misses());
+		executionInfo.insert("qureg-pool-hits", QuregPool::instance().hits());
+		executionInfo.insert("qureg-pool-misses", QuregPool::instance().misses());
+
 	}
 
 	QuestDefaultVisitor::~QuestDefaultVisitor() {}
 
+	void QuestDefaultVisitor::releaseResources() {
+
+		if(env)
+			QuregPool::instance().drain(*env);
+
+	}
+
+	bool QuestDefaultVisitor::replayKernel(std::shared_ptr<CompositeInstruction> in_kernel) {
+
+		recording = false;
+
+		if(!structuralKey(in_kernel, lookupKey))
+			return false;
+		addTapeSettings(lookupKey);
+
+		const auto compiled = GateTapeCache::instance().find(lookupKey);
+		if(!compiled){
+			recording = true;
+			recordedKey = lookupKey;
+			recordedOps.clear();
+			orderQubits(in_kernel);
+			return false;
+		}
+
+		flushGates();
+		compiled->tape.apply(*qreg);
+		measured_bits.insert(compiled->measuredBits.begin(), compiled->measuredBits.end());
+
+		countTapeOps(compiled->tape);
+
+		if(testing){
+			updateStateVectorInfo(*qreg, buffer);
+		}
+
+		return true;
+
+	}
+
+	bool QuestDefaultVisitor::bindParameters(std::shared_ptr<CompositeInstruction> in_kernel, const std::vector<double>& in_parameters) {
+
+		const auto compiled = parametricKernel(in_kernel, in_parameters.size());
+		if(!compiled)
+			return false;
+
+		flushGates();
+		const auto& tape = compiled->bind(in_parameters);
+		tape.apply(*qreg);
+		measured_bits.insert(compiled->measuredBits().begin(), compiled->measuredBits().end());
+
+		countTapeOps(tape);
+
+		if(testing){
+			updateStateVectorInfo(*qreg, buffer);
+		}
+
+		return true;
+
+	}
+
+	std::shared_ptr<ParametricKernel> QuestDefaultVisitor::parametricKernel(std::shared_ptr<CompositeInstruction> in_kernel, size_t in_nbVariables) {
+
+		if(!structuralKey(in_kernel, lookupKey, true))
+			return nullptr;
+		addTapeSettings(lookupKey);
+
+		std::shared_ptr<ParametricKernel> compiled;
+		if(!GateTapeCache::instance().findParametric(lookupKey, compiled)){
+			compiled = compileParametric(in_kernel, in_nbVariables);
+			GateTapeCache::instance().insertParametric(lookupKey, compiled);
+		}
+
+		if(!compiled || compiled->nbVariables() != in_nbVariables)
+			return nullptr;
+
+		return compiled;
+
+	}
+
+	bool QuestDefaultVisitor::computeGradient(std::shared_ptr<CompositeInstruction> in_kernel, const std::vector<double>& in_parameters,
+			std::shared_ptr<Observable> in_observable, std::vector<double>& out_gradient, double& out_value) {
+
+		auto observable = std::dynamic_pointer_cast<xacc::quantum::PauliOperator>(in_observable);
+		if(!observable)
+			return false;
+
+		const auto compiled = parametricKernel(in_kernel, in_parameters.size());
+		if(!compiled || !compiled->measuredBits().empty())
+			return false;
+
+		std::vector<kernels::PauliString> pauliTerms;
+		std::vector<double> coefficients;
+		const double constant = toPauliTerms(*observable, pauliTerms, coefficients);
+
+		auto evaluate = [&](const Qureg& in_qreg){
+			const auto values = kernels::calcExpectationValuesPauli(in_qreg, pauliTerms);
+			double result = constant;
+			for(size_t t = 0; t < values.size(); ++t)
+				result += coefficients[t] * values[t];
+			return result;
+		};
+
+		flushGates();
+
+		const std::string method = options.stringExists("gradient-method") ? options.getString("gradient-method") : "parameter-shift";
+		executionInfo.insert("gradient-method", method);
+
+		if(method == "adjoint"){
+			const auto& tape = compiled->bind(in_parameters);
+			tape.apply(*qreg);
+			countTapeOps(tape);
+			out_value = evaluate(*qreg);
+			out_gradient = adjointGradient(*compiled, pauliTerms, coefficients);
+			return true;
+		}
+
+		if(method != "parameter-shift")
+			xacc::error("QuestDefaultVisitor: unknown gradient-method '" + method + "', expected parameter-shift or adjoint");
+
+		// Every gate parameter depending on the variables is shifted by +-pi/2: all the supported rotations
+		// (Rx, Ry, Rz and the three angles of U) have generators with eigenvalues +-1/2, CPhase the projector on |11>
+		// with eigenvalues 0 and 1, i.e. two eigenvalues 1 apart, so that d<H>/dp = (<H>(p + pi/2) - <H>(p - pi/2)) / 2.
+		const auto& parameters = compiled->parameters();
+		const int nbEvaluations = 2 * parameters.size();
+		std::vector<double> shiftedValues(nbEvaluations);
+
+		int nbWorkers = 1;
+#ifdef _OPENMP
+		nbWorkers = omp_get_max_threads();
+#endif
+		if(options.keyExists<int>("gradient-threads"))
+			nbWorkers = options.get<int>("gradient-threads");
+		nbWorkers = std::max(1, std::min(nbWorkers, nbEvaluations));
+
+		// Each worker has its own register and its own copy of the kernel to patch
+		std::vector<Qureg> workerQregs;
+		for(int w = 0; w < nbWorkers; ++w)
+			workerQregs.push_back(QuregPool::instance().acquire(qreg->numQubitsInStateVec, *env, false));
+		std::vector<ParametricKernel> workerKernels(nbWorkers, *compiled);
+
+		// The shifted circuits start from the initial state of the register, which is evolved last
+		#pragma omp parallel for num_threads(nbWorkers) schedule(static, 1)
+		for(int w = 0; w < nbWorkers; ++w){
+			for(int e = w; e < nbEvaluations; e += nbWorkers){
+				kernels::copyStateVector(*qreg, workerQregs[w]);
+				workerKernels[w].bind(in_parameters, e / 2, e % 2 == 0 ? M_PI_2 : -M_PI_2).apply(workerQregs[w]);
+				shiftedValues[e] = evaluate(workerQregs[w]);
+			}
+		}
+
+		for(auto& workerQreg : workerQregs)
+			QuregPool::instance().release(workerQreg, *env);
+
+		const auto& tape = compiled->bind(in_parameters);
+		tape.apply(*qreg);
+		countTapeOps(tape);
+		out_value = evaluate(*qreg);
+
+		out_gradient.assign(in_parameters.size(), 0.0);
+		for(size_t i = 0; i < parameters.size(); ++i){
+			const double derivative = (shiftedValues[2 * i] - shiftedValues[2 * i + 1]) / 2.0;
+			for(const auto& coefficient : parameters[i].coefficients)
+				out_gradient[coefficient.first] += coefficient.second * derivative;
+		}
+
+		executionInfo.insert("gradient-evaluations", nbEvaluations);
+		executionInfo.insert("gradient-threads", nbWorkers);
+
+		return true;
+
+	}
+
+	std::vector<double> QuestDefaultVisitor::adjointGradient(const ParametricKernel& in_kernel, const std::vector<kernels::PauliString>& in_terms,
+			const std::vector<double>& in_coefficients) {
+
+		const auto& ops = in_kernel.loweredOps();
+		const auto& parameters = in_kernel.parameters();
+
+		std::vector<std::vector<size_t>> opParameters(ops.size());
+		for(size_t i = 0; i < parameters.size(); ++i)
+			opParameters[parameters[i].op].push_back(i);
+
+		// phi walks the state back from the final one, lambda holds H applied to the final state
+		// walked back alongside it, and mu the derivative of the current gate applied to phi.
+		// The constant term of H is left out as it contributes nothing to the gradient.
+		const int nbQubits = qreg->numQubitsInStateVec;
+		Qureg phi = QuregPool::instance().acquire(nbQubits, *env, false);
+		Qureg lambda = QuregPool::instance().acquire(nbQubits, *env, false);
+		Qureg mu = QuregPool::instance().acquire(nbQubits, *env, false);
+
+		kernels::copyStateVector(*qreg, phi);
+		kernels::applyPauliSum(*qreg, lambda, in_terms, in_coefficients);
+
+		std::vector<double> gradient(in_kernel.nbVariables(), 0.0);
+
+		for(size_t g = ops.size(); g-- > 0;){
+
+			const auto inverse = ops[g].adjoint();
+			applyGateOp(phi, inverse);
+
+			// d<H>/dp = 2 Re <lambda| dU/dp |phi>
+			for(const auto& i : opParameters[g]){
+				kernels::copyStateVector(phi, mu);
+				const auto derivative = ops[g].derivative(parameters[i].param);
+				kernels::applyMatrix(mu, ops[g].qubits.data(), ops[g].qubits.size(), derivative.data());
+				const double partial = 2.0 * kernels::calcInnerProductReal(lambda, mu);
+				for(const auto& coefficient : parameters[i].coefficients)
+					gradient[coefficient.first] += coefficient.second * partial;
+			}
+
+			if(g > 0)
+				applyGateOp(lambda, inverse);
+		}
+
+		QuregPool::instance().release(phi, *env);
+		QuregPool::instance().release(lambda, *env);
+		QuregPool::instance().release(mu, *env);
+
+		return gradient;
+
+	}
+
+	std::shared_ptr<ParametricKernel> QuestDefaultVisitor::compileParametric(std::shared_ptr<CompositeInstruction> in_kernel, size_t in_nbVariables) {
+
+		// Gates are lowered by the visit() methods, capturing the queued ops instead of applying them
+		auto lowerAt = [&](const std::vector<double>& in_variables, std::vector<GateOp>& out_ops, std::set<size_t>& out_measuredBits) {
+			auto evaluated = (*in_kernel)(in_variables);
+			orderQubits(evaluated);
+			InstructionIterator it(evaluated);
+			while (it.hasNext())
+			{
+				auto nextInst = it.next();
+				if (!nextInst->isEnabled() || nextInst->isComposite())
+					continue;
+				if (nextInst->name() == "Measure")
+					out_measuredBits.insert(registerQubit(nextInst->bits()[0]));
+				else
+					nextInst->accept(this);
+			}
+			resolveQubitMap();
+			out_ops.swap(pendingOps);
+			pendingOps.clear();
+		};
+
+		std::vector<GateOp> lowered;
+		std::set<size_t> measuredBits;
+		lowerAt(std::vector<double>(in_nbVariables, 0.0), lowered, measuredBits);
+
+		// Measurements can only be replayed at the end of the kernel
+		if(!measuredBits.empty() && !terminalMeasurements)
+			return nullptr;
+
+		auto sameStructure = [&](const std::vector<GateOp>& in_ops){
+			if(in_ops.size() != lowered.size())
+				return false;
+			for(size_t g = 0; g < lowered.size(); ++g)
+				if(in_ops[g].kind != lowered[g].kind || in_ops[g].qubits != lowered[g].qubits)
+					return false;
+			return true;
+		};
+
+		// Parameter values at each unit vector give the coefficients of the variables,
+		// assuming the parameters are affine in them.
+		std::map<std::pair<size_t, size_t>, AffineParameter> parameters;
+		for(size_t v = 0; v < in_nbVariables; ++v){
+
+			std::vector<double> variables(in_nbVariables, 0.0);
+			variables[v] = 1.0;
+
+			std::vector<GateOp> ops;
+			std::set<size_t> bits;
+			lowerAt(variables, ops, bits);
+			if(!sameStructure(ops))
+				return nullptr;
+
+			for(size_t g = 0; g < ops.size(); ++g)
+				for(size_t p = 0; p < ops[g].params.size(); ++p){
+					const double coefficient = ops[g].params[p] - lowered[g].params[p];
+					if(coefficient == 0.0)
+						continue;
+					auto& parameter = parameters[std::make_pair(g, p)];
+					parameter.op = g;
+					parameter.param = p;
+					parameter.offset = lowered[g].params[p];
+					parameter.coefficients.push_back(std::make_pair(v, coefficient));
+				}
+		}
+
+		// Check the affine model at another point, e.g. sin(theta) or theta * phi parameters are not affine
+		std::vector<double> variables(in_nbVariables);
+		for(size_t v = 0; v < in_nbVariables; ++v)
+			variables[v] = 0.5 + 0.25 * v;
+
+		std::vector<GateOp> ops;
+		std::set<size_t> bits;
+		lowerAt(variables, ops, bits);
+		if(!sameStructure(ops))
+			return nullptr;
+
+		for(size_t g = 0; g < ops.size(); ++g)
+			for(size_t p = 0; p < ops[g].params.size(); ++p){
+				double expected = lowered[g].params[p];
+				const auto parameter = parameters.find(std::make_pair(g, p));
+				if(parameter != parameters.end())
+					for(const auto& coefficient : parameter->second.coefficients)
+						expected += coefficient.second * variables[coefficient.first];
+				// Written so that non-finite values fail too
+				if(!(std::abs(ops[g].params[p] - expected) <= 1e-9 * (1.0 + std::abs(expected))))
+					return nullptr;
+			}
+
+		std::vector<AffineParameter> affineParameters;
+		for(const auto& parameter : parameters)
+			affineParameters.push_back(parameter.second);
+
+		for(size_t g = 0; g < lowered.size(); ++g)
+			lowered[g].sources = {g};
+
+		return std::make_shared<ParametricKernel>(lowered, affineParameters, runPasses(lowered), in_nbVariables, measuredBits);
+
+	}
+
+	void QuestDefaultVisitor::addTapeSettings(TapeKey& io_key) const {
+
+		// The tape also depends on the register width and on the passes it was compiled with
+		for(const int setting : {n_qbits, (int)terminalMeasurements, (int)gateFusion, fusionMaxQubits, (int)diagonalAccumulation,
+			(int)permutationComposition, (int)swapRelabeling, cacheBlockQubits, (int)(qubitOrdering && !global_qreg), layerMaxQubits})
+			io_key.add(setting);
+		// and on the buffer qubits the register stands for, the kernel being lowered onto it
+		io_key.add(bufferQubits.size());
+		for(const auto& qubit : bufferQubits)
+			io_key.add(qubit);
+
+	}
+
+	std::vector<GateOp> QuestDefaultVisitor::runPasses(const std::vector<GateOp>& in_ops) const {
+
+		auto ops = in_ops;
+		// Diagonal runs that fit in a fused block are left to the fusion
+		if(diagonalAccumulation)
+			ops = accumulateDiagonalGates(ops, gateFusion ? fusionMaxQubits + 1 : 1);
+		// So are the permutation runs
+		if(permutationComposition)
+			ops = composePermutations(ops, gateFusion ? fusionMaxQubits + 1 : 1);
+		if(gateFusion)
+			ops = fuseGates(ops, fusionMaxQubits);
+		// Blocks are kept below the register width, so that there are enough of them to share between the threads
+		if(cacheBlockQubits > 0)
+			ops = scheduleCacheBlocks(ops, qreg->numQubitsInStateVec, std::min(cacheBlockQubits, qreg->numQubitsInStateVec - MIN_BLOCK_BITS));
+		// The ops left out of the windows, mostly on the higher qubits, are swept layer by layer
+		if(layerMaxQubits > 0)
+			ops = groupLayers(ops, qreg->numQubitsInStateVec, layerMaxQubits);
+
+		return ops;
+
+	}
+
+	void QuestDefaultVisitor::countTapeOps(const GateTape& in_tape) {
+
+		const auto diagonalRuns = in_tape.count(GateOp::Diagonal);
+		const auto fusedBlocks = in_tape.count(GateOp::Fused);
+		const auto permutationRuns = in_tape.count(GateOp::Permutation);
+		const auto cacheWindows = in_tape.count(GateOp::Window);
+		const auto layers = in_tape.count(GateOp::Layer);
+		nbDiagonalRuns += diagonalRuns.first;
+		nbDiagonalGates += diagonalRuns.second;
+		nbFusedBlocks += fusedBlocks.first;
+		nbFusedGates += fusedBlocks.second;
+		nbPermutationRuns += permutationRuns.first;
+		nbPermutationGates += permutationRuns.second;
+		nbCacheWindows += cacheWindows.first;
+		nbCacheWindowGates += cacheWindows.second;
+		nbLayers += layers.first;
+		nbLayerGates += layers.second;
+
+	}
+
+	void QuestDefaultVisitor::orderQubits(std::shared_ptr<CompositeInstruction> in_kernel) {
+
+		// Only a register in the zero state (i.e. not the global one) is left unchanged by the reordering
+		std::vector<int> positions;
+		if(!qubitOrdering || global_qreg || !pendingOps.empty() || !hotQubitOrder(in_kernel, registerQubits, physicalQubits.size(), positions))
+			return;
+
+		physicalQubits = positions;
+		for(int qubit = 0; qubit < (int)positions.size(); ++qubit)
+			nbReorderedQubits += positions[qubit] != qubit;
+
+	}
+
+	void QuestDefaultVisitor::resolveQubitMap() {
+
+		// Swaps bringing each logical qubit back to its own index, from the lowest one
+		std::vector<GateOp> swaps;
+		for(int logical = 0; logical < (int)physicalQubits.size(); ++logical){
+			const int physical = physicalQubits[logical];
+			if(physical == logical)
+				continue;
+			const int displaced = std::find(physicalQubits.begin(), physicalQubits.end(), logical) - physicalQubits.begin();
+			swaps.push_back(GateOp::lower(GateOp::Swap, {logical, physical}));
+			physicalQubits[displaced] = physical;
+			physicalQubits[logical] = logical;
+		}
+
+		// All of them composed into a single pass
+		if(!swaps.empty())
+			pendingOps.push_back(composePermutations(swaps, 1).front());
+
+	}
+
+	void QuestDefaultVisitor::flushGates() {
+
+		resolveQubitMap();
+
+		if(pendingOps.empty())
+			return;
+
+		const auto ops = runPasses(pendingOps);
+
+		// Through a tape, which applies the cache-blocked windows
+		const GateTape tape(ops);
+		tape.apply(*qreg);
+		countTapeOps(tape);
+
+		// Gates of the observed sub-circuits, applied on the scratch register, are not part of the kernel
+		if(recording && qreg != &termQreg)
+			recordedOps.insert(recordedOps.end(), ops.begin(), ops.end());
+
+		pendingOps.clear();
+
+		if(testing){
+			updateStateVectorInfo(*qreg, buffer);
+		}
+
+	}
+
 	void QuestDefaultVisitor::updateStateVectorInfo(Qureg &qreg, std::shared_ptr<AcceleratorBuffer> buffer){
 
 		std::vector<double> stateVectReal;
 		std::vector<double> stateVectImag;
 
+		// The state of the whole buffer, in which the qubits left out of the register are in |0>
+		if(!bufferQubits.empty()){
+			stateVectReal.assign(1ULL << buffer->size(), 0.0);
+			stateVectImag.assign(1ULL << buffer->size(), 0.0);
+			for(size_t i = 0; i < qreg.numAmpsTotal; ++i){
+				size_t index = 0;
+				for(size_t bit = 0; bit < bufferQubits.size(); ++bit)
+					index |= ((i >> bit) & 1ULL) << bufferQubits[bit];
+				stateVectReal[index] = qreg.stateVec.real[i];
+				stateVectImag[index] = qreg.stateVec.imag[i];
+			}
+			buffer->addExtraInfo("statevect_real", stateVectReal);
+			buffer->addExtraInfo("statevect_imag", stateVectImag);
+			return;
+		}
+
 		for(size_t i = 0; i < qreg.numAmpsTotal; ++i)
 			stateVectReal.push_back(qreg.stateVec.real[i]);
 
@@ -147,14 +903,10 @@ namespace quacc {
 		std::cout << "applying " << gate.name() << " @ " << iqbit_in << std::endl;
 	  }
 
-	  hadamard(*qreg, iqbit_in);
+	  queueGate(GateOp::lower(GateOp::H, {(int)iqbit_in}));
 
 	  execTime += singleQubitTime;
 
-	  if(testing){
-	  		  updateStateVectorInfo(*qreg, buffer);
-	  }
-
 	}
 
 	void QuestDefaultVisitor::visit(CZ &gate) {
@@ -166,13 +918,9 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ control " << iqbit_c << " to " << iqbit_q << std::endl;
 		  }
 
-		  controlledPhaseFlip(*qreg, iqbit_c, iqbit_q);
+		  queueGate(GateOp::lower(GateOp::CZ, {(int)iqbit_c, (int)iqbit_q}));
 
 		  execTime += twoQubitTime;
-
-		  if(testing){
-			  updateStateVectorInfo(*qreg, buffer);
-		  }
 	}
 
 	void QuestDefaultVisitor::visit(CNOT &gate) {
@@ -184,13 +932,9 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ control " << iqbit_c << " to " << iqbit_q << std::endl;
 		  }
 
-		 controlledNot(*qreg, iqbit_c, iqbit_q);
+		 queueGate(GateOp::lower(GateOp::CNOT, {(int)iqbit_c, (int)iqbit_q}));
 
 		 execTime += twoQubitTime;
-
-		 if(testing){
-			 updateStateVectorInfo(*qreg, buffer);
-		 }
 	}
 
 	void QuestDefaultVisitor::visit(X &gate) {
@@ -201,13 +945,9 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ " << iqbit_in << std::endl;
 		}
 
-		pauliX(*qreg, iqbit_in);
+		queueGate(GateOp::lower(GateOp::X, {(int)iqbit_in}));
 
 		execTime += singleQubitTime;
-
-		if(testing){
-			updateStateVectorInfo(*qreg, buffer);
-		}
 	}
 
 	void QuestDefaultVisitor::visit(Y &gate) {
@@ -218,13 +958,9 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ " << iqbit_in << std::endl;
 		}
 
-		pauliY(*qreg, iqbit_in);
+		queueGate(GateOp::lower(GateOp::Y, {(int)iqbit_in}));
 
 		execTime += singleQubitTime;
-
-		if(testing){
-			updateStateVectorInfo(*qreg, buffer);
-		}
 	}
 
 	void QuestDefaultVisitor::visit(Z &gate) {
@@ -235,75 +971,154 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ " << iqbit_in << std::endl;
 		}
 
-		pauliZ(*qreg, iqbit_in);
+		queueGate(GateOp::lower(GateOp::Z, {(int)iqbit_in}));
 
 		execTime += singleQubitTime;
-
-		if(testing){
-			updateStateVectorInfo(*qreg, buffer);
-		}
 	}
 
 	void QuestDefaultVisitor::visit(Measure &gate) {
 
 		auto iqbit_in = gate.bits()[0];
-		measured_bits.insert(iqbit_in);
+		measured_bits.insert(registerQubit(iqbit_in));
 
 		if (verbose) {
 			std::cout << "applying " << gate.name() << " @ " << iqbit_in << std::endl;
 		}
 
-		measured_bits.insert(iqbit_in);
+		// Terminal measurements are all performed at once in finalize()
+		if(terminalMeasurements)
+			return;
 
-		Qureg *active_qreg;
-		if(buffer->hasExtraInfoKey("repeated_measurement_mode") &&
-						  buffer->getInformation("repeated_measurement_mode").as<std::string>()=="true")
-			active_qreg = &qreg2;
-		else
-			active_qreg = qreg;
+		measureQubit(registerQubit(iqbit_in), measured_bits);
+
+	}
+
+	void QuestDefaultVisitor::measureQubit(size_t in_bit, const std::set<size_t>& in_measuredBits){
+
+		flushGates();
+		recording = false;
 
-		const double expectedValueZ = this -> calcExpectationValueZ(active_qreg->stateVec, measured_bits);
+		Qureg *active_qreg = &measurementQreg();
+
+		const double expectedValueZ = this -> calcExpectationValueZ(active_qreg->stateVec, in_measuredBits);
 		buffer->addExtraInfo("exp-val-z", expectedValueZ);
 
-		const int measured = measure(*active_qreg, iqbit_in);
+		const int measured = measure(*active_qreg, in_bit);
 
-		buffer->measure(iqbit_in, measured);
+		buffer->measure(bufferQubit(in_bit), measured);
 
 
 		if(testing){
 			updateStateVectorInfo(*active_qreg, buffer);
 		}
 
+	}
+
+	void QuestDefaultVisitor::measureTerminal(){
+
+		// Too many measured qubits to tabulate their joint distribution, measure them one by one
+		if(measured_bits.size() > kernels::MAX_JOINT_BITS){
+			std::set<size_t> bits;
+			for(const auto& bit : measured_bits){
+				bits.insert(bit);
+				measureQubit(bit, bits);
+			}
+			return;
+		}
+
+		Qureg &active_qreg = measurementQreg();
+
+		const auto probabilities = kernels::calcJointProbabilities(active_qreg, measured_bits);
+
+		double expectedValueZ = 0.0;
+		for(size_t outcome = 0; outcome < probabilities.size(); ++outcome)
+			expectedValueZ += (__builtin_parityll(outcome) ? -1.0 : 1.0) * probabilities[outcome];
+		buffer->addExtraInfo("exp-val-z", expectedValueZ);
+
+		std::discrete_distribution<uint64_t> distribution(probabilities.begin(), probabilities.end());
+		const uint64_t outcome = distribution(rng);
+
+		kernels::collapseToOutcome(active_qreg, measured_bits, outcome, probabilities[outcome]);
+
+		int position = 0;
+		for(const auto& bit : measured_bits)
+			buffer->measure(bufferQubit(bit), (outcome >> position++) & 1ULL);
+
+		if(testing){
+			updateStateVectorInfo(active_qreg, buffer);
+		}
 
 	}
 
-	const double QuestDefaultVisitor::calcExpectationValueZ(ComplexArray in_stateVec, const std::set<size_t>& in_bits){
+	Qureg& QuestDefaultVisitor::measurementQreg(){
 
-		const auto hasEvenParity = [](size_t x, const std::set<size_t>& in_qubitIndices) -> bool {
+		if(buffer->hasExtraInfoKey("repeated_measurement_mode") &&
+				buffer->getInformation("repeated_measurement_mode").as<std::string>()=="true")
+			return qreg2;
 
-			size_t count = 0;
-			for (const auto& bitIdx : in_qubitIndices) {
-				if (x & (1ULL << bitIdx))
-					count++;
-			}
-			return (count % 2) == 0;
-		};
+		return *qreg;
 
-		double result = 0.0;
+	}
 
-		for(uint64_t i = 0; i < qreg->numAmpsTotal; ++i)
-		{
-			result += (hasEvenParity(i, in_bits) ? 1.0 : -1.0) * std::norm(std::complex<double>(in_stateVec.real[i], in_stateVec.imag[i]));
+	void QuestDefaultVisitor::sampleMeasurements(){
+
+		Qureg &active_qreg = measurementQreg();
+
+		// As when measuring once, the exact parity expectation of the measured qubits rather than the sampled one
+		buffer->addExtraInfo("exp-val-z", calcExpectationValueZ(active_qreg.stateVec, measured_bits));
+
+		const auto counts = kernels::sampleBasisStates(active_qreg, n_shots, rng);
+
+		// Bitstrings list the measured qubits from the highest index to the lowest one,
+		// which the buffer qubits standing for them are in as well.
+		std::map<std::string, int> bitStringCounts;
+		for(const auto& count : counts){
+
+			const uint64_t outcome = kernels::gatherBits(count.first, measured_bits);
+
+			std::string bitString(measured_bits.size(), '0');
+			for(size_t i = 0; i < measured_bits.size(); ++i)
+				if((outcome >> i) & 1ULL)
+					bitString[measured_bits.size() - 1 - i] = '1';
+
+			bitStringCounts[bitString] += count.second;
 		}
 
-		return result;
+		for(const auto& bitStringCount : bitStringCounts)
+			buffer->appendMeasurement(bitStringCount.first, bitStringCount.second);
 
+	}
+
+	const double QuestDefaultVisitor::calcExpectationValueZ(ComplexArray in_stateVec, const std::set<size_t>& in_bits){
+
+		uint64_t zMask = 0;
+		for(const auto& bitIdx : in_bits)
+			zMask |= 1ULL << bitIdx;
+
+		return kernels::calcExpectationValueZ(in_stateVec, qreg->numAmpsTotal, zMask);
 
 	}
 
 	const double QuestDefaultVisitor::getExpectationValueZ(std::shared_ptr<CompositeInstruction> function){
 
-		auto cachedStateVec = qreg->stateVec;
+		flushGates();
+
+		// Pauli terms are evaluated directly on the ansatz state, without any change of basis.
+		uint64_t xMask, zMask;
+		double sign;
+		if(toPauliMasks(function, registerQubits, xMask, zMask, sign))
+			return sign * kernels::calcExpectationValuePauli(*qreg, xMask, zMask);
+
+		// The change of basis is applied to a copy of the ansatz state,
+		// so that the ansatz state remains available for the next terms.
+		Qureg *ansatzQreg = qreg;
+		if(!termQregAllocated){
+			termQreg = QuregPool::instance().acquire(ansatzQreg->numQubitsInStateVec, *env, false);
+			termQregAllocated = true;
+		}
+		kernels::copyStateVector(*ansatzQreg, termQreg);
+		qreg = &termQreg;
+
 		std::set<size_t> measureBitIdxs;
 
 		InstructionIterator it(function);
@@ -314,7 +1129,7 @@ namespace quacc {
 			{
 				if (nextInst->name() == "Measure")
 				{
-					measureBitIdxs.insert(nextInst->bits()[0]);
+					measureBitIdxs.insert(registerQubit(nextInst->bits()[0]));
 				}
 				else
 				{
@@ -324,10 +1139,59 @@ namespace quacc {
 			}
 		}
 
+		flushGates();
 		const double result = calcExpectationValueZ(qreg->stateVec, measureBitIdxs);
-		// Restore the state vector
-		qreg->stateVec = cachedStateVec;
-		std::cout<<"WARNING!!!! THIS MIGHT BE VERY INEFFICIENT WAY TO DO IT! BECAUSE WE CREATE A COPY OF STATEVECTOR> THINK ABOUT BETTER ONE!";
+
+		qreg = ansatzQreg;
+
+		return result;
+
+	}
+
+	std::vector<double> QuestDefaultVisitor::getExpectationValuesZ(const std::vector<std::shared_ptr<CompositeInstruction>>& functions){
+
+		flushGates();
+
+		std::vector<double> results(functions.size(), 0.0);
+
+		// Pauli terms are batched, any other sub-circuit is evaluated on its own.
+		std::vector<kernels::PauliString> pauliTerms;
+		std::vector<size_t> pauliTermIdxs;
+		std::vector<double> pauliTermSigns;
+
+		for(size_t i = 0; i < functions.size(); ++i){
+
+			uint64_t xMask, zMask;
+			double sign;
+			if(toPauliMasks(functions[i], registerQubits, xMask, zMask, sign)){
+				pauliTerms.push_back({xMask, zMask});
+				pauliTermIdxs.push_back(i);
+				pauliTermSigns.push_back(sign);
+			}else{
+				results[i] = getExpectationValueZ(functions[i]);
+			}
+		}
+
+		const auto pauliValues = kernels::calcExpectationValuesPauli(*qreg, pauliTerms);
+		for(size_t t = 0; t < pauliTerms.size(); ++t)
+			results[pauliTermIdxs[t]] = pauliTermSigns[t] * pauliValues[t];
+
+		return results;
+
+	}
+
+	double QuestDefaultVisitor::getExpectationValue(xacc::quantum::PauliOperator& observable){
+
+		flushGates();
+
+		std::vector<kernels::PauliString> pauliTerms;
+		std::vector<double> coefficients;
+		double result = toPauliTerms(observable, pauliTerms, coefficients);
+
+		const auto pauliValues = kernels::calcExpectationValuesPauli(*qreg, pauliTerms);
+		for(size_t t = 0; t < pauliTerms.size(); ++t)
+			result += coefficients[t] * pauliValues[t];
+
 		return result;
 
 	}
@@ -342,14 +1206,10 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ " << iqbit_in << "  theta: " << theta << std::endl;
 		}
 
-		rotateX(*qreg, iqbit_in, theta);
+		queueGate(GateOp::lower(GateOp::Rx, {(int)iqbit_in}, {theta}));
 
 		execTime += singleQubitTime;
 
-		if(testing){
-			updateStateVectorInfo(*qreg, buffer);
-		}
-
 	}
 
 	void QuestDefaultVisitor::visit(Ry &gate) {
@@ -362,13 +1222,9 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ " << iqbit_in << "  theta: " << theta << std::endl;
 		}
 
-		rotateY(*qreg, iqbit_in, theta);
+		queueGate(GateOp::lower(GateOp::Ry, {(int)iqbit_in}, {theta}));
 
 		execTime += singleQubitTime;
-
-		if(testing){
-			updateStateVectorInfo(*qreg, buffer);
-		}
 	}
 
 	void QuestDefaultVisitor::visit(Rz &gate) {
@@ -380,13 +1236,9 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ " << iqbit_in << "  theta: " << theta << std::endl;
 		}
 
-		rotateZ(*qreg, iqbit_in, theta);
+		queueGate(GateOp::lower(GateOp::Rz, {(int)iqbit_in}, {theta}));
 
 		execTime += singleQubitTime;
-
-		if(testing){
-			updateStateVectorInfo(*qreg, buffer);
-		}
 	}
 
 	void QuestDefaultVisitor::visit(U &gate) {
@@ -397,24 +1249,12 @@ namespace quacc {
 		const double pi = InstructionParameterToDouble(gate.getParameter(1));
 		const double lambda = InstructionParameterToDouble(gate.getParameter(2));
 
-		ComplexMatrix2 u;
-
-		u.real[0][0] = cos(theta/2.);				u.real[0][1] = -sin(theta/2.) * cos(lambda);
-		u.imag[0][0] = 0;							u.imag[0][1] = -sin(theta/2.) * sin(lambda);
-
-		u.real[1][0] = sin(theta/2.) * cos(pi);		u.real[1][1] = cos(theta/2.) * cos(pi+lambda);
-		u.imag[1][0] = sin(theta/2.) * sin(pi);		u.imag[1][1] = cos(theta/2.) * sin(pi+lambda);
-
 		if (verbose) {
 			std::cout << "applying " << gate.name() << " @ " << iqbit_in << "  theta: "
 					<< theta << "   pi: " << pi << "   lambda: " << lambda << std::endl;
 		}
 
-		unitary(*qreg, iqbit_in, u);
-
-		if(testing){
-			updateStateVectorInfo(*qreg, buffer);
-		}
+		queueGate(GateOp::lower(GateOp::U, {(int)iqbit_in}, {theta, pi, lambda}));
 
 	}
 
@@ -429,14 +1269,10 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ control " << iqbit_c << " to " << iqbit_q << "theta:  " << iqbit_q << std::endl;
 		}
 
-		controlledPhaseShift(*qreg, iqbit_c, iqbit_q, theta);
+		queueGate(GateOp::lower(GateOp::CPhase, {(int)iqbit_c, (int)iqbit_q}, {theta}));
 
 		execTime += twoQubitTime;
 
-		if(testing){
-			updateStateVectorInfo(*qreg, buffer);
-		}
-
 	}
 
 	void QuestDefaultVisitor::visit(Swap &gate) {
@@ -448,14 +1284,17 @@ namespace quacc {
 			std::cout << "applying " << gate.name() << " @ control " << iqbit_c << " to " << iqbit_q << std::endl;
 		}
 
-		swapGate(*qreg, iqbit_c, iqbit_q);
+		// Only the qubit labels are exchanged, the gates that follow being queued on the swapped qubits.
+		if(swapRelabeling){
+			std::swap(physicalQubits[registerQubit(iqbit_c)], physicalQubits[registerQubit(iqbit_q)]);
+			++nbRelabeledSwaps;
+			return;
+		}
+
+		queueGate(GateOp::lower(GateOp::Swap, {(int)iqbit_c, (int)iqbit_q}));
 
 		execTime += twoQubitTime;
 
-		if(testing){
-			updateStateVectorInfo(*qreg, buffer);
-		}
-
 	}
 
 } // namespace quacc
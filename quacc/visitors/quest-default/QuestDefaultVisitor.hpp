@@ -34,10 +34,15 @@
 #define QUEST_DEFAULT_VISITOR_HPP_
 
 #include <cstdlib>
+#include <random>
 #include "Cloneable.hpp"
+#include "PauliOperator.hpp"
 
 #include "../../../../quacc/visitors/quest-default/QuEST/include/QuEST.h"
 #include "../../QuaccVisitor.hpp"
+#include "GateOps.hpp"
+#include "ParametricKernel.hpp"
+#include "GateTapeCache.hpp"
 
 namespace quacc {
 
@@ -52,10 +57,26 @@ public:
   }
 
   virtual const double getExpectationValueZ(std::shared_ptr<CompositeInstruction> function);
+  virtual std::vector<double> getExpectationValuesZ(const std::vector<std::shared_ptr<CompositeInstruction>>& functions) override;
+  // <psi|H|psi> of a whole Pauli observable against the current state,
+  // with one pass over the state vector per distinct X/Y flip pattern of its terms.
+  double getExpectationValue(xacc::quantum::PauliOperator& observable);
   virtual const double calcExpectationValueZ(ComplexArray in_stateVec, const std::set<size_t>& in_bits);
 
   virtual void initialize(std::shared_ptr<AcceleratorBuffer> buffer) override;
+  virtual bool replayKernel(std::shared_ptr<CompositeInstruction> kernel) override;
+  virtual bool bindParameters(std::shared_ptr<CompositeInstruction> kernel, const std::vector<double>& parameters) override;
+  virtual bool computeGradient(std::shared_ptr<CompositeInstruction> kernel, const std::vector<double>& parameters,
+		  std::shared_ptr<Observable> observable, std::vector<double>& gradient, double& value) override;
   virtual void finalize() override;
+  // Destroys the registers pooled for env.
+  virtual void releaseResources() override;
+
+  virtual bool supportShotSampling() const override { return true; }
+  // The ansatz state is simulated once and each observed term is evaluated against it.
+  virtual bool supportVqeMode() const override { return true; }
+  // Qubits left out of the register are put back, in |0>, in the reported state.
+  virtual bool supportActiveQubits() const override { return true; }
 
   // Service name as defined in manifest.json
   virtual const std::string name() const { return "quest-default"; }
@@ -94,9 +115,13 @@ public:
 
 private:
 
-  QuESTEnv *env;
+  QuESTEnv *env = nullptr;
   Qureg *qreg;
   Qureg qreg2;
+  // Scratch register the observed terms are evaluated on in VQE mode,
+  // allocated once per ansatz and refreshed from the ansatz state for every term.
+  Qureg termQreg;
+  bool termQregAllocated = false;
 
   bool initialized;
   bool global_qreg;
@@ -110,10 +135,98 @@ private:
   std::set<size_t> measured_bits; // indecies of qbits to measure
 
   int n_qbits;
+  // Buffer qubit each qubit of the register stands for, empty if they are the same (see setActiveQubits())
+  std::vector<size_t> bufferQubits;
+  size_t bufferQubit(size_t bit) const { return bufferQubits.empty() ? bit : bufferQubits[bit]; }
+  // Register qubit each qubit of the buffer (i.e. of the kernel) stands for, the kernels being lowered through it
+  std::vector<size_t> registerQubits;
+  size_t registerQubit(size_t bit) const { return registerQubits[bit]; }
+  int n_shots = -1;
   bool verbose = false, testing = false;
 
+  std::mt19937_64 rng;
+
+  // Gates are queued by visit() and applied in one go when the state is needed,
+  // so that the whole run can be rewritten first (e.g. fused), see flushGates().
+  std::vector<GateOp> pendingOps;
+  bool gateFusion = true;
+  bool diagonalAccumulation = true;
+  bool permutationComposition = true;
+  bool swapRelabeling = true;
+  // Kernels start with their most targeted qubits on the lowest indices, see orderQubits()
+  bool qubitOrdering = true;
+  // Windows of gates on the qubits below cacheBlockQubits are applied block by block, see scheduleCacheBlocks()
+  int cacheBlockQubits = 0;
+  // Qubits above the blocks, at least: 2^MIN_BLOCK_BITS blocks to share between the threads
+  static constexpr int MIN_BLOCK_BITS = 4;
+  // Consecutive ops on at most layerMaxQubits qubits are applied in a single sweep, see groupLayers().
+  // Each tile of a sweep covers LAYER_TILE_QUBITS = 12 qubits, and a layer may touch at most 6 of them by default:
+  // the other 6 are the lowest qubits of the state, so that each tile is copied in runs of 64 consecutive amplitudes.
+  int layerMaxQubits = 6;
+  int fusionMaxQubits = 2;
+  // Blocks applied as a fused matrix during the execution, and the gates they stood for
+  int nbFusedBlocks = 0;
+  int nbFusedGates = 0;
+  // Runs of diagonal gates applied as a single phase pass, and the gates they stood for
+  int nbDiagonalRuns = 0;
+  int nbDiagonalGates = 0;
+  // Runs of permutation gates applied as a single composed permutation, and the gates they stood for
+  int nbPermutationRuns = 0;
+  int nbPermutationGates = 0;
+  // Swaps applied by relabeling the qubits instead of moving amplitudes
+  int nbRelabeledSwaps = 0;
+  // Qubits moved to another index by the qubit ordering
+  int nbReorderedQubits = 0;
+  // Cache-blocked windows, and the gates they stood for
+  int nbCacheWindows = 0;
+  int nbCacheWindowGates = 0;
+  // Layers swept at once, and the gates they stood for
+  int nbLayers = 0;
+  int nbLayerGates = 0;
+
+  // Physical qubit each logical qubit of the kernel lives on. Swap gates only exchange two entries,
+  // the qubits are put back in place by a single pass when the state is needed, see resolveQubitMap().
+  std::vector<int> physicalQubits;
+
+  // Ops applied while executing a kernel that is not in the tape cache yet, stored at finalize().
+  // Recording is dropped if the kernel turns out not to be replayable (mid-circuit measurement).
+  bool recording = false;
+  TapeKey recordedKey;
+  // Key of the kernel looked up in the tape cache, refilled for every execution
+  TapeKey lookupKey;
+  std::vector<GateOp> recordedOps;
+
+  void queueGate(GateOp op) {
+	for(auto& qubit : op.qubits)
+	  qubit = physicalQubits[registerQubit(qubit)];
+	pendingOps.push_back(op);
+  }
+  // Places the qubits kernel targets the most on the lowest indices of the register, through the qubit map,
+  // if kernel is executed from the zero state and has enough gates to gain from it.
+  void orderQubits(std::shared_ptr<CompositeInstruction> kernel);
+  // Queues the permutation putting every logical qubit back on its own index
+  void resolveQubitMap();
+  void flushGates();
+  std::vector<GateOp> runPasses(const std::vector<GateOp>& ops) const;
+  // Completes the key of a kernel structure in the tape cache with the current register width and pass settings
+  void addTapeSettings(TapeKey& key) const;
+  void countTapeOps(const GateTape& tape);
+  // The compiled form of kernel, from the tape cache or compiled now, nullptr if it cannot be compiled
+  std::shared_ptr<ParametricKernel> parametricKernel(std::shared_ptr<CompositeInstruction> kernel, size_t nbVariables);
+  // Gradient by adjoint differentiation: one backward sweep over the gates of in_kernel (bound, and applied to *qreg),
+  // with three more registers, instead of two simulations per parameter.
+  std::vector<double> adjointGradient(const ParametricKernel& kernel, const std::vector<kernels::PauliString>& terms,
+		  const std::vector<double>& coefficients);
+  // nullptr if the gate parameters are not affine in the kernel variables
+  std::shared_ptr<ParametricKernel> compileParametric(std::shared_ptr<CompositeInstruction> kernel, size_t nbVariables);
+
   void updateStateVectorInfo(Qureg &qreg, std::shared_ptr<AcceleratorBuffer> buffer); //used for testing
 
+  Qureg& measurementQreg();
+  void measureQubit(size_t in_bit, const std::set<size_t>& in_measuredBits);
+  void measureTerminal(); // measures all of measured_bits at once, from their joint distribution
+  void sampleMeasurements(); // draws n_shots bitstrings over measured_bits from a single simulation
+
 };
 
 } // namespace quacc
@@ -0,0 +1,150 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#include "QuregPool.hpp"
+
+namespace quacc {
+
+	QuregPool& QuregPool::instance() {
+		static QuregPool pool;
+		return pool;
+	}
+
+	Qureg QuregPool::acquire(int in_nbQubits, QuESTEnv &in_env, bool in_zeroState) {
+
+		Qureg qreg;
+		bool pooled = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			auto &registers = available[Key(&in_env, in_nbQubits, sizeof(qreal))];
+
+			if (!registers.empty()) {
+				qreg = registers.back();
+				registers.pop_back();
+				pooledBytes -= bytes(qreg);
+				pooled = true;
+				++nbHits;
+			} else {
+				++nbMisses;
+			}
+		}
+
+		// Freshly created registers are already in the |0...0> state.
+		if (!pooled)
+			return createQureg(in_nbQubits, in_env);
+
+		// Zeroed outside the lock, the register being ours alone once popped
+		if (in_zeroState)
+			initZeroState(qreg);
+		return qreg;
+
+	}
+
+	void QuregPool::release(Qureg &in_qreg, QuESTEnv &in_env) {
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			if (pooledBytes + bytes(in_qreg) <= capacity) {
+				available[Key(&in_env, in_qreg.numQubitsRepresented, sizeof(qreal))].push_back(in_qreg);
+				pooledBytes += bytes(in_qreg);
+				return;
+			}
+		}
+
+		destroyQureg(in_qreg, in_env);
+
+	}
+
+	void QuregPool::setCapacity(size_t in_bytes) {
+
+		std::vector<std::pair<Key, Qureg>> evicted;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			capacity = in_bytes;
+			evict(capacity, evicted);
+		}
+
+		for (auto &qreg : evicted)
+			destroyQureg(qreg.second, *std::get<0>(qreg.first));
+
+	}
+
+	void QuregPool::drain(const QuESTEnv &in_env) {
+
+		std::vector<Qureg> drained;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto registers = available.begin(); registers != available.end();) {
+				if (std::get<0>(registers->first) != &in_env) {
+					++registers;
+					continue;
+				}
+				for (const auto &qreg : registers->second) {
+					pooledBytes -= bytes(qreg);
+					drained.push_back(qreg);
+				}
+				registers = available.erase(registers);
+			}
+		}
+
+		for (auto &qreg : drained)
+			destroyQureg(qreg, in_env);
+
+	}
+
+	size_t QuregPool::bytes(const Qureg &in_qreg) {
+		// Real and imaginary parts of the amplitudes held by this process
+		return 2 * sizeof(qreal) * (size_t)in_qreg.numAmpsPerChunk;
+	}
+
+	void QuregPool::evict(size_t in_bytes, std::vector<std::pair<Key, Qureg>> &out_evicted) {
+
+		// The widest registers first, as they free the most memory
+		for (auto registers = available.rbegin(); registers != available.rend() && pooledBytes > in_bytes; ++registers) {
+			while (!registers->second.empty() && pooledBytes > in_bytes) {
+				pooledBytes -= bytes(registers->second.back());
+				out_evicted.emplace_back(registers->first, registers->second.back());
+				registers->second.pop_back();
+			}
+		}
+
+	}
+
+	int QuregPool::hits() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return nbHits;
+	}
+
+	int QuregPool::misses() const {
+		std::lock_guard<std::mutex> lock(mutex);
+		return nbMisses;
+	}
+
+} // namespace quacc
@@ -0,0 +1,86 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#ifndef QUACC_QUREG_POOL_HPP_
+#define QUACC_QUREG_POOL_HPP_
+
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include "../../../../quacc/visitors/quest-default/QuEST/include/QuEST.h"
+
+namespace quacc {
+
+	// Registers released by finished executions, kept allocated (and already page-faulted)
+	// so that following executions of the same width reuse them instead of allocating anew.
+	// Registers are keyed by the QuESTEnv they were created in, their number of qubits and precision,
+	// and kept up to a total size in bytes. They must be drained before their QuESTEnv is destroyed.
+	class QuregPool {
+
+		public:
+
+		  static QuregPool& instance();
+
+		  // A register of in_nbQubits qubits, reset to |0...0> unless in_zeroState is false.
+		  Qureg acquire(int in_nbQubits, QuESTEnv &in_env, bool in_zeroState = true);
+		  // Hands in_qreg back to the pool, or destroys it if the pool would exceed its capacity.
+		  void release(Qureg &in_qreg, QuESTEnv &in_env);
+
+		  // Bytes of state vectors kept in all, registers above it are destroyed.
+		  void setCapacity(size_t in_bytes);
+		  // Destroys all the registers kept for in_env, e.g. before in_env itself is destroyed.
+		  void drain(const QuESTEnv &in_env);
+
+		  int hits() const;
+		  int misses() const;
+
+		private:
+
+		  typedef std::tuple<const QuESTEnv*, int, size_t> Key;
+
+		  QuregPool() = default;
+
+		  static size_t bytes(const Qureg &in_qreg);
+		  // Takes registers out of available until at most in_bytes are kept, into out_evicted
+		  void evict(size_t in_bytes, std::vector<std::pair<Key, Qureg>> &out_evicted);
+
+		  mutable std::mutex mutex;
+		  std::map<Key, std::vector<Qureg>> available;
+		  // 1 GB, e.g. two 25-qubit registers in double precision
+		  size_t capacity = 1ULL << 30;
+		  size_t pooledBytes = 0;
+		  int nbHits = 0;
+		  int nbMisses = 0;
+	};
+
+} // namespace quacc
+
+#endif /* QUACC_QUREG_POOL_HPP_ */
@@ -0,0 +1,893 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "StateVectorKernels.hpp"
+
+namespace quacc {
+namespace kernels {
+
+	namespace {
+		// Number of contiguous chunks the state vector is split into for the parallel passes.
+		// Fixed (i.e. independent of the thread count) so that the results are reproducible.
+		constexpr long long NB_BLOCKS = 1024;
+
+		inline double probability(const ComplexArray &in_stateVec, long long in_idx) {
+			return in_stateVec.real[in_idx] * in_stateVec.real[in_idx] + in_stateVec.imag[in_idx] * in_stateVec.imag[in_idx];
+		}
+
+		inline double paritySign(uint64_t in_idx, uint64_t in_mask) {
+			return __builtin_parityll(in_idx & in_mask) ? -1.0 : 1.0;
+		}
+
+		// Accumulates in_width sums with in_accumulate(begin, end, sums) over fixed blocks of [0, in_size), in parallel.
+		// The partial sums are added in block order, so the result does not depend on the thread count.
+		// Wide accumulations use fewer blocks, to bound the memory taken by the partial sums.
+		template <typename BlockAccumulate>
+		std::vector<double> sumOverBlocks(long long in_size, size_t in_width, BlockAccumulate in_accumulate) {
+
+			constexpr long long MAX_PARTIAL_SUMS = 1LL << 22;
+			const long long maxBlocks = std::max(1LL, std::min(NB_BLOCKS, MAX_PARTIAL_SUMS / (long long)in_width));
+			const long long nbBlocks = std::max(1LL, std::min(in_size, maxBlocks));
+			const long long blockSize = (in_size + nbBlocks - 1) / nbBlocks;
+			std::vector<double> partialSums(nbBlocks * in_width, 0.0);
+
+			#pragma omp parallel for schedule(static)
+			for (long long b = 0; b < nbBlocks; ++b)
+				in_accumulate(std::min(in_size, b * blockSize), std::min(in_size, (b + 1) * blockSize), &partialSums[b * in_width]);
+
+			std::vector<double> result(in_width, 0.0);
+			for (long long b = 0; b < nbBlocks; ++b)
+				for (size_t w = 0; w < in_width; ++w)
+					result[w] += partialSums[b * in_width + w];
+
+			return result;
+
+		}
+
+		template <typename BlockSum>
+		double sumOverBlocks(long long in_size, BlockSum in_blockSum) {
+			return sumOverBlocks(in_size, 1, [&](long long in_begin, long long in_end, double *io_sum) {
+				*io_sum += in_blockSum(in_begin, in_end);
+			})[0];
+		}
+	}
+
+	namespace {
+		constexpr long long LOW_BLOCK = 1LL << LOW_QUBITS;
+
+		constexpr long long insertZeroBit(long long in_idx, int in_bit) {
+			return ((in_idx >> in_bit) << (in_bit + 1)) | (in_idx & ((1LL << in_bit) - 1));
+		}
+
+		// Splits in_dim x in_dim in_matrix into its real and imaginary parts
+		template <int DIM>
+		struct SplitMatrix {
+			SplitMatrix(const std::complex<double> *in_matrix) {
+				for (int k = 0; k < DIM * DIM; ++k) {
+					re[k] = in_matrix[k].real();
+					im[k] = in_matrix[k].imag();
+				}
+			}
+			double re[DIM * DIM];
+			double im[DIM * DIM];
+		};
+
+		// Applies in_m to the amplitudes in_i0 and in_i1
+		inline void mix2(qreal *io_re, qreal *io_im, long long in_i0, long long in_i1, const SplitMatrix<2> &in_m) {
+			const double ar = io_re[in_i0], ai = io_im[in_i0];
+			const double br = io_re[in_i1], bi = io_im[in_i1];
+			io_re[in_i0] = in_m.re[0] * ar - in_m.im[0] * ai + in_m.re[1] * br - in_m.im[1] * bi;
+			io_im[in_i0] = in_m.re[0] * ai + in_m.im[0] * ar + in_m.re[1] * bi + in_m.im[1] * br;
+			io_re[in_i1] = in_m.re[2] * ar - in_m.im[2] * ai + in_m.re[3] * br - in_m.im[3] * bi;
+			io_im[in_i1] = in_m.re[2] * ai + in_m.im[2] * ar + in_m.re[3] * bi + in_m.im[3] * br;
+		}
+
+		// The loops over a block have constant trip counts and indices, the compiler unrolls them.
+		template <int TARGET>
+		void matrix1Low(Qureg &io_qreg, const SplitMatrix<2> &in_m) {
+
+			qreal *re = io_qreg.stateVec.real;
+			qreal *im = io_qreg.stateVec.imag;
+			const long long nbBlocks = io_qreg.numAmpsTotal / LOW_BLOCK;
+
+			#pragma omp parallel for schedule(static)
+			for (long long b = 0; b < nbBlocks; ++b) {
+				const long long base = b * LOW_BLOCK;
+				for (long long k = 0; k < LOW_BLOCK / 2; ++k) {
+					const long long i0 = base + insertZeroBit(k, TARGET);
+					mix2(re, im, i0, i0 + (1LL << TARGET), in_m);
+				}
+			}
+
+		}
+
+		template <int CONTROL, int TARGET>
+		void controlledMatrix1Low(Qureg &io_qreg, const SplitMatrix<2> &in_m) {
+
+			constexpr int LOW = CONTROL < TARGET ? CONTROL : TARGET;
+			constexpr int HIGH = CONTROL < TARGET ? TARGET : CONTROL;
+
+			qreal *re = io_qreg.stateVec.real;
+			qreal *im = io_qreg.stateVec.imag;
+			const long long nbBlocks = io_qreg.numAmpsTotal / LOW_BLOCK;
+
+			#pragma omp parallel for schedule(static)
+			for (long long b = 0; b < nbBlocks; ++b) {
+				const long long base = b * LOW_BLOCK;
+				for (long long k = 0; k < LOW_BLOCK / 4; ++k) {
+					const long long i0 = base + (insertZeroBit(insertZeroBit(k, LOW), HIGH) | (1LL << CONTROL));
+					mix2(re, im, i0, i0 + (1LL << TARGET), in_m);
+				}
+			}
+
+		}
+
+		// in_m has its index bit 0 on LOW
+		template <int LOW, int HIGH>
+		void matrix2Low(Qureg &io_qreg, const SplitMatrix<4> &in_m) {
+
+			constexpr long long OFFSETS[4] = {0, 1LL << LOW, 1LL << HIGH, (1LL << LOW) | (1LL << HIGH)};
+
+			qreal *re = io_qreg.stateVec.real;
+			qreal *im = io_qreg.stateVec.imag;
+			const long long nbBlocks = io_qreg.numAmpsTotal / LOW_BLOCK;
+
+			#pragma omp parallel for schedule(static)
+			for (long long b = 0; b < nbBlocks; ++b) {
+				const long long base = b * LOW_BLOCK;
+				for (long long k = 0; k < LOW_BLOCK / 4; ++k) {
+					const long long i = base + insertZeroBit(insertZeroBit(k, LOW), HIGH);
+					double ar[4], ai[4];
+					for (int c = 0; c < 4; ++c) {
+						ar[c] = re[i + OFFSETS[c]];
+						ai[c] = im[i + OFFSETS[c]];
+					}
+					for (int r = 0; r < 4; ++r) {
+						double sumRe = 0.0, sumIm = 0.0;
+						for (int c = 0; c < 4; ++c) {
+							sumRe += in_m.re[4 * r + c] * ar[c] - in_m.im[4 * r + c] * ai[c];
+							sumIm += in_m.re[4 * r + c] * ai[c] + in_m.im[4 * r + c] * ar[c];
+						}
+						re[i + OFFSETS[r]] = sumRe;
+						im[i + OFFSETS[r]] = sumIm;
+					}
+				}
+			}
+
+		}
+
+		static_assert(LOW_QUBITS == 4, "the kernel tables below list the low qubits");
+
+		typedef void (*Matrix1Kernel)(Qureg&, const SplitMatrix<2>&);
+		typedef void (*Matrix2Kernel)(Qureg&, const SplitMatrix<4>&);
+
+		const Matrix1Kernel MATRIX1_LOW[LOW_QUBITS] = {matrix1Low<0>, matrix1Low<1>, matrix1Low<2>, matrix1Low<3>};
+
+		// By control, then target
+		const Matrix1Kernel CONTROLLED_MATRIX1_LOW[LOW_QUBITS][LOW_QUBITS] = {
+			{nullptr, controlledMatrix1Low<0, 1>, controlledMatrix1Low<0, 2>, controlledMatrix1Low<0, 3>},
+			{controlledMatrix1Low<1, 0>, nullptr, controlledMatrix1Low<1, 2>, controlledMatrix1Low<1, 3>},
+			{controlledMatrix1Low<2, 0>, controlledMatrix1Low<2, 1>, nullptr, controlledMatrix1Low<2, 3>},
+			{controlledMatrix1Low<3, 0>, controlledMatrix1Low<3, 1>, controlledMatrix1Low<3, 2>, nullptr}};
+
+		// By lower, then higher qubit
+		const Matrix2Kernel MATRIX2_LOW[LOW_QUBITS][LOW_QUBITS] = {
+			{nullptr, matrix2Low<0, 1>, matrix2Low<0, 2>, matrix2Low<0, 3>},
+			{nullptr, nullptr, matrix2Low<1, 2>, matrix2Low<1, 3>},
+			{nullptr, nullptr, nullptr, matrix2Low<2, 3>},
+			{nullptr, nullptr, nullptr, nullptr}};
+	}
+
+	void applyMatrix1Low(Qureg &io_qreg, int in_target, const std::complex<double> *in_matrix) {
+		MATRIX1_LOW[in_target](io_qreg, SplitMatrix<2>(in_matrix));
+	}
+
+	void applyControlledMatrix1Low(Qureg &io_qreg, int in_control, int in_target, const std::complex<double> *in_matrix) {
+		CONTROLLED_MATRIX1_LOW[in_control][in_target](io_qreg, SplitMatrix<2>(in_matrix));
+	}
+
+	void applyMatrix2Low(Qureg &io_qreg, int in_qubit0, int in_qubit1, const std::complex<double> *in_matrix) {
+
+		if (in_qubit0 < in_qubit1) {
+			MATRIX2_LOW[in_qubit0][in_qubit1](io_qreg, SplitMatrix<4>(in_matrix));
+			return;
+		}
+
+		// Exchanges the two bits of the matrix indices, so that bit 0 is the lower qubit
+		std::complex<double> swapped[16];
+		for (int r = 0; r < 4; ++r)
+			for (int c = 0; c < 4; ++c)
+				swapped[((r & 1) << 1 | r >> 1) * 4 + ((c & 1) << 1 | c >> 1)] = in_matrix[r * 4 + c];
+		MATRIX2_LOW[in_qubit1][in_qubit0](io_qreg, SplitMatrix<4>(swapped));
+
+	}
+
+	namespace {
+		// Image of in_idx by in_permutation, which is its own inverse
+		inline uint64_t permute(uint64_t in_idx, const BitPermutation &in_permutation) {
+			const bool moved = (in_idx & in_permutation.controlMask) == in_permutation.controlMask
+					&& (in_permutation.swapMask == 0 || __builtin_popcountll(in_idx & in_permutation.swapMask) == 1);
+			return moved ? in_idx ^ in_permutation.flipMask ^ in_permutation.swapMask : in_idx;
+		}
+
+		// An uncontrolled flip or swap, or a singly controlled flip, maps in_idx to A in_idx ^ b over GF(2)
+		inline bool isAffine(const BitPermutation &in_permutation) {
+			return __builtin_popcountll(in_permutation.controlMask) + (in_permutation.swapMask != 0) <= 1;
+		}
+	}
+
+	void applyBitPermutation(Qureg &io_qreg, const BitPermutation &in_permutation) {
+
+		// Each exchanged pair is visited once, from its member having the lowest moved bit clear
+		// (and for a swap, the other swapped bit set) and all the controls set.
+		const uint64_t moved = in_permutation.flipMask | in_permutation.swapMask;
+		const uint64_t pivot = moved & (~moved + 1);
+		const uint64_t fixedMask = in_permutation.controlMask | pivot | in_permutation.swapMask;
+		const uint64_t fixedValue = in_permutation.controlMask | (in_permutation.swapMask & ~pivot);
+
+		std::vector<int> fixedBits;
+		for (int bit = 0; bit < 64; ++bit)
+			if ((fixedMask >> bit) & 1ULL)
+				fixedBits.push_back(bit);
+
+		qreal *re = io_qreg.stateVec.real;
+		qreal *im = io_qreg.stateVec.imag;
+		const long long nbPairs = io_qreg.numAmpsTotal >> fixedBits.size();
+
+		#pragma omp parallel for schedule(static)
+		for (long long k = 0; k < nbPairs; ++k) {
+			long long i = k;
+			for (const auto &bit : fixedBits)
+				i = insertZeroBit(i, bit);
+			i |= fixedValue;
+			const long long j = i ^ moved;
+			std::swap(re[i], re[j]);
+			std::swap(im[i], im[j]);
+		}
+
+	}
+
+	void applyBitPermutations(Qureg &io_qreg, const BitPermutation *in_permutations, size_t in_nbPermutations) {
+
+		const long long numAmps = io_qreg.numAmpsTotal;
+		qreal *re = io_qreg.stateVec.real;
+		qreal *im = io_qreg.stateVec.imag;
+
+		// The amplitude landing on j comes from the inverse permutation of j: each permutation
+		// being its own inverse, the permutations are undone in reverse order.
+		auto source = [&](uint64_t in_idx) {
+			for (size_t p = in_nbPermutations; p-- > 0;)
+				in_idx = permute(in_idx, in_permutations[p]);
+			return in_idx;
+		};
+
+		// source(j) = source(0) ^ the sum over GF(2) of source(2^b) ^ source(0) for the bits b set in j,
+		// tabulated per byte of j: resolving an index costs a few lookups, whatever the number of gates.
+		const bool affine = std::all_of(in_permutations, in_permutations + in_nbPermutations, isAffine);
+		const int nbQubits = io_qreg.numQubitsInStateVec;
+		const int nbBytes = (nbQubits + 7) / 8;
+		const uint64_t offset = source(0);
+		std::vector<uint64_t> tables(affine ? nbBytes * 256 : 0, 0);
+		if (affine)
+			for (int bit = 0; bit < nbQubits; ++bit) {
+				const uint64_t column = source(1ULL << bit) ^ offset;
+				const int byte = bit / 8;
+				for (int value = 0; value < 256; ++value)
+					if ((value >> (bit % 8)) & 1)
+						tables[byte * 256 + value] ^= column;
+			}
+
+		auto from = [&](uint64_t in_idx) {
+			if (!affine)
+				return source(in_idx);
+			uint64_t result = offset;
+			for (int byte = 0; byte < nbBytes; ++byte)
+				result ^= tables[byte * 256 + ((in_idx >> (8 * byte)) & 255)];
+			return result;
+		};
+
+		// In place, cycle by cycle: each cycle is rotated once, from its lowest index, which is the only one
+		// of the cycle not reaching a lower index before coming back to itself. Short cycles (one or two
+		// elements for a single gate) are the common case, so most indices are settled in a step or two.
+		#pragma omp parallel for schedule(dynamic, 4096)
+		for (long long i = 0; i < numAmps; ++i) {
+
+			uint64_t j = from(i);
+			while (j > (uint64_t) i)
+				j = from(j);
+			if (j != (uint64_t) i)
+				continue;
+
+			const qreal leaderRe = re[i];
+			const qreal leaderIm = im[i];
+			uint64_t to = i;
+			for (uint64_t next = from(i); next != (uint64_t) i; next = from(next)) {
+				re[to] = re[next];
+				im[to] = im[next];
+				to = next;
+			}
+			re[to] = leaderRe;
+			im[to] = leaderIm;
+		}
+
+	}
+
+	PhaseTable preparePhaseTerms(const PhaseTerm *in_terms, size_t in_nbTerms, int in_nbQubits) {
+
+		// Amplitudes are processed in blocks of 2^lowBits. Terms on the low bits only are tabulated once,
+		// terms on the high bits only are constant over a block, and a term on one low and one high bit
+		// is linear in the low bit within a block: those are tabulated per block over chunks of low bits.
+		PhaseTable table;
+		table.lowBits = std::min(in_nbQubits, PhaseTable::LOW_BITS);
+		const long long lowDim = 1LL << table.lowBits;
+		const uint64_t lowMask = lowDim - 1;
+
+		double globalPhase = 0.0;
+		std::vector<PhaseTerm> lowTerms;
+		// Per low bit, the terms it shares with a high bit
+		table.crossTerms.resize(table.lowBits);
+		table.hasCrossTerms = false;
+
+		for (size_t t = 0; t < in_nbTerms; ++t) {
+			const auto &term = in_terms[t];
+			if (term.mask == 0) {
+				globalPhase += term.angle;
+			} else if ((term.mask & ~lowMask) == 0) {
+				lowTerms.push_back(term);
+			} else if ((term.mask & lowMask) == 0) {
+				table.highTerms.push_back(term);
+			} else {
+				table.crossTerms[__builtin_ctzll(term.mask & lowMask)].push_back({term.mask & ~lowMask, term.angle});
+				table.hasCrossTerms = true;
+			}
+		}
+
+		table.lowTable.resize(lowDim);
+		for (long long lo = 0; lo < lowDim; ++lo) {
+			double phase = globalPhase;
+			for (const auto &term : lowTerms)
+				if (((uint64_t)lo & term.mask) == term.mask)
+					phase += term.angle;
+			table.lowTable[lo] = std::polar(1.0, phase);
+		}
+
+		return table;
+
+	}
+
+	void applyPhaseTable(Qureg &io_qreg, const PhaseTable &in_table) {
+
+		typedef std::complex<double> Factor;
+
+		constexpr int CHUNK_BITS = 6;
+		constexpr int NB_CHUNKS = PhaseTable::LOW_BITS / CHUNK_BITS;
+
+		const int lowBits = in_table.lowBits;
+		const long long lowDim = 1LL << lowBits;
+		const auto &lowTable = in_table.lowTable;
+		const auto &crossTerms = in_table.crossTerms;
+		const bool hasCrossTerms = in_table.hasCrossTerms;
+
+		qreal *re = io_qreg.stateVec.real;
+		qreal *im = io_qreg.stateVec.imag;
+		const long long nbBlocks = io_qreg.numAmpsTotal >> lowBits;
+
+		#pragma omp parallel for schedule(static) if(nbBlocks > 1)
+		for (long long b = 0; b < nbBlocks; ++b) {
+
+			const uint64_t highIdx = (uint64_t)b << lowBits;
+
+			double highPhase = 0.0;
+			for (const auto &term : in_table.highTerms)
+				if ((highIdx & term.mask) == term.mask)
+					highPhase += term.angle;
+			const Factor highFactor = std::polar(1.0, highPhase);
+
+			Factor chunkTables[NB_CHUNKS][1 << CHUNK_BITS];
+			if (hasCrossTerms) {
+				for (int c = 0; c < NB_CHUNKS; ++c) {
+					chunkTables[c][0] = 1.0;
+					for (int j = 0; j < CHUNK_BITS; ++j) {
+						const int bit = c * CHUNK_BITS + j;
+						double angle = 0.0;
+						if (bit < lowBits)
+							for (const auto &term : crossTerms[bit])
+								if ((highIdx & term.mask) == term.mask)
+									angle += term.angle;
+						const Factor factor = std::polar(1.0, angle);
+						for (int v = 0; v < (1 << j); ++v)
+							chunkTables[c][v | (1 << j)] = chunkTables[c][v] * factor;
+					}
+				}
+			}
+
+			for (long long lo = 0; lo < lowDim; ++lo) {
+				Factor factor = highFactor * lowTable[lo];
+				if (hasCrossTerms)
+					for (int c = 0; c < NB_CHUNKS; ++c)
+						factor *= chunkTables[c][(lo >> (c * CHUNK_BITS)) & ((1 << CHUNK_BITS) - 1)];
+				const long long i = highIdx | lo;
+				const double r = re[i], m = im[i];
+				re[i] = r * factor.real() - m * factor.imag();
+				im[i] = r * factor.imag() + m * factor.real();
+			}
+		}
+
+	}
+
+	void applyPhaseTerms(Qureg &io_qreg, const PhaseTerm *in_terms, size_t in_nbTerms) {
+
+		applyPhaseTable(io_qreg, preparePhaseTerms(in_terms, in_nbTerms, io_qreg.numQubitsInStateVec));
+
+	}
+
+	namespace {
+
+		// Multiplies by in_matrix the group of amplitudes whose first one is in_base
+		inline void mixGroup(qreal *io_re, qreal *io_im, long long in_base, const MatrixLayout &in_layout,
+				const std::complex<double> *in_matrix, std::complex<double> *io_group) {
+
+			const long long dim = in_layout.offsets.size();
+			const long long *offsets = in_layout.offsets.data();
+
+			for (long long k = 0; k < dim; ++k)
+				io_group[k] = std::complex<double>(io_re[in_base + offsets[k]], io_im[in_base + offsets[k]]);
+
+			for (long long r = 0; r < dim; ++r) {
+				std::complex<double> amplitude = 0.0;
+				for (long long c = 0; c < dim; ++c)
+					amplitude += in_matrix[r * dim + c] * io_group[c];
+				io_re[in_base + offsets[r]] = amplitude.real();
+				io_im[in_base + offsets[r]] = amplitude.imag();
+			}
+
+		}
+
+		// Inserts a zero bit at every target position
+		inline long long groupBase(long long in_group, const std::vector<int> &in_sortedTargets) {
+			long long base = in_group;
+			for (const auto &target : in_sortedTargets)
+				base = ((base >> target) << (target + 1)) | (base & ((1LL << target) - 1));
+			return base;
+		}
+
+	}
+
+	MatrixLayout prepareMatrix(const int *in_targets, int in_nbTargets) {
+
+		MatrixLayout layout;
+		layout.targets.assign(in_targets, in_targets + in_nbTargets);
+		layout.sortedTargets = layout.targets;
+		std::sort(layout.sortedTargets.begin(), layout.sortedTargets.end());
+
+		// Offset of each matrix index from the first amplitude of its group
+		layout.offsets.assign(1LL << in_nbTargets, 0);
+		for (long long k = 0; k < (long long) layout.offsets.size(); ++k)
+			for (int t = 0; t < in_nbTargets; ++t)
+				if ((k >> t) & 1LL)
+					layout.offsets[k] |= 1LL << in_targets[t];
+
+		return layout;
+
+	}
+
+	void applyMatrix(Qureg &io_qreg, const MatrixLayout &in_layout, const std::complex<double> *in_matrix, std::complex<double> *io_scratch) {
+
+		qreal *re = io_qreg.stateVec.real;
+		qreal *im = io_qreg.stateVec.imag;
+		const long long nbGroups = io_qreg.numAmpsTotal >> in_layout.targets.size();
+
+		if (in_layout.targets.size() == 1) {
+			const SplitMatrix<2> m(in_matrix);
+			const int target = in_layout.targets[0];
+			for (long long k = 0; k < nbGroups; ++k) {
+				const long long i0 = insertZeroBit(k, target);
+				mix2(re, im, i0, i0 + (1LL << target), m);
+			}
+			return;
+		}
+
+		for (long long g = 0; g < nbGroups; ++g)
+			mixGroup(re, im, groupBase(g, in_layout.sortedTargets), in_layout, in_matrix, io_scratch);
+
+	}
+
+	void applyMatrix(Qureg &io_qreg, const int *in_targets, int in_nbTargets, const std::complex<double> *in_matrix) {
+
+		const long long nbGroups = io_qreg.numAmpsTotal >> in_nbTargets;
+
+		if (in_nbTargets == 1) {
+			const SplitMatrix<2> m(in_matrix);
+			qreal *re = io_qreg.stateVec.real;
+			qreal *im = io_qreg.stateVec.imag;
+			#pragma omp parallel for schedule(static)
+			for (long long k = 0; k < nbGroups; ++k) {
+				const long long i0 = insertZeroBit(k, in_targets[0]);
+				mix2(re, im, i0, i0 + (1LL << in_targets[0]), m);
+			}
+			return;
+		}
+
+		const MatrixLayout layout = prepareMatrix(in_targets, in_nbTargets);
+
+		qreal *re = io_qreg.stateVec.real;
+		qreal *im = io_qreg.stateVec.imag;
+
+		#pragma omp parallel
+		{
+			std::vector<std::complex<double>> group(layout.offsets.size());
+
+			#pragma omp for schedule(static)
+			for (long long g = 0; g < nbGroups; ++g)
+				mixGroup(re, im, groupBase(g, layout.sortedTargets), layout, in_matrix, group.data());
+		}
+
+	}
+
+	void applyPauliSum(const Qureg &in_qreg, Qureg &out_qreg, const std::vector<PauliString> &in_terms, const std::vector<double> &in_coefficients) {
+
+		const qreal *re = in_qreg.stateVec.real;
+		const qreal *im = in_qreg.stateVec.imag;
+		qreal *outRe = out_qreg.stateVec.real;
+		qreal *outIm = out_qreg.stateVec.imag;
+
+		// (P psi)_j = (-i)^nY (-1)^|j & zMask| psi_(j ^ xMask)
+		std::vector<std::complex<double>> factors;
+		for (size_t t = 0; t < in_terms.size(); ++t) {
+			const int nbY = __builtin_popcountll(in_terms[t].xMask & in_terms[t].zMask);
+			const std::complex<double> phases[] = {1.0, {0.0, -1.0}, -1.0, {0.0, 1.0}};
+			factors.push_back(in_coefficients[t] * phases[nbY % 4]);
+		}
+
+		#pragma omp parallel for schedule(static)
+		for (long long j = 0; j < in_qreg.numAmpsTotal; ++j) {
+			std::complex<double> amplitude = 0.0;
+			for (size_t t = 0; t < in_terms.size(); ++t) {
+				const long long k = j ^ (long long)in_terms[t].xMask;
+				amplitude += paritySign(j, in_terms[t].zMask) * factors[t] * std::complex<double>(re[k], im[k]);
+			}
+			outRe[j] = amplitude.real();
+			outIm[j] = amplitude.imag();
+		}
+
+	}
+
+	double calcInnerProductReal(const Qureg &in_bra, const Qureg &in_ket) {
+
+		const qreal *braRe = in_bra.stateVec.real;
+		const qreal *braIm = in_bra.stateVec.imag;
+		const qreal *ketRe = in_ket.stateVec.real;
+		const qreal *ketIm = in_ket.stateVec.imag;
+
+		return sumOverBlocks(in_bra.numAmpsTotal, [&](long long in_begin, long long in_end) {
+			double sum = 0.0;
+			#pragma omp simd reduction(+:sum)
+			for (long long i = in_begin; i < in_end; ++i)
+				sum += braRe[i] * ketRe[i] + braIm[i] * ketIm[i];
+			return sum;
+		});
+
+	}
+
+	std::map<uint64_t, int> sampleBasisStates(const Qureg &in_qreg, int in_shots, std::mt19937_64 &in_rng) {
+
+		std::map<uint64_t, int> result;
+		if (in_shots < 1)
+			return result;
+
+		const long long numAmps = in_qreg.numAmpsTotal;
+		const long long nbBlocks = std::min(numAmps, NB_BLOCKS);
+		const long long blockSize = (numAmps + nbBlocks - 1) / nbBlocks;
+		const ComplexArray stateVec = in_qreg.stateVec;
+
+		// First pass: probability mass of every block, turned into a cumulative distribution over the blocks.
+		std::vector<double> cumulative(nbBlocks + 1, 0.0);
+
+		#pragma omp parallel for schedule(static)
+		for (long long b = 0; b < nbBlocks; ++b) {
+			const long long end = std::min(numAmps, (b + 1) * blockSize);
+			double blockProb = 0.0;
+			for (long long i = b * blockSize; i < end; ++i)
+				blockProb += probability(stateVec, i);
+			cumulative[b + 1] = blockProb;
+		}
+
+		std::partial_sum(cumulative.begin(), cumulative.end(), cumulative.begin());
+		const double total = cumulative.back();
+
+		// Sorted uniform draws, so that each block only needs to look at a contiguous range of them.
+		std::uniform_real_distribution<double> uniform(0.0, total);
+		std::vector<double> draws(in_shots);
+		for (auto &draw : draws)
+			draw = std::min(uniform(in_rng), std::nextafter(total, 0.0));
+		std::sort(draws.begin(), draws.end());
+
+		// Second pass: only the blocks that received draws are walked, each one independently.
+		std::vector<std::vector<std::pair<uint64_t, int>>> blockCounts(nbBlocks);
+
+		#pragma omp parallel for schedule(dynamic)
+		for (long long b = 0; b < nbBlocks; ++b) {
+
+			auto first = std::lower_bound(draws.begin(), draws.end(), cumulative[b]);
+			const auto last = std::lower_bound(first, draws.end(), cumulative[b + 1]);
+			if (first == last)
+				continue;
+
+			const long long end = std::min(numAmps, (b + 1) * blockSize);
+			double partial = 0.0;
+			long long lastPopulated = -1;
+
+			for (long long i = b * blockSize; i < end && first != last; ++i) {
+				const double prob = probability(stateVec, i);
+				if (prob == 0.0)
+					continue;
+
+				partial += prob;
+				lastPopulated = i;
+
+				int count = 0;
+				while (first != last && *first - cumulative[b] < partial) {
+					++first;
+					++count;
+				}
+				if (count > 0)
+					blockCounts[b].emplace_back(i, count);
+			}
+
+			// Draws left over by rounding belong to the last populated amplitude of the block.
+			if (first != last) {
+				const int count = std::distance(first, last);
+				if (!blockCounts[b].empty() && blockCounts[b].back().first == (uint64_t)lastPopulated)
+					blockCounts[b].back().second += count;
+				else
+					blockCounts[b].emplace_back(lastPopulated, count);
+			}
+		}
+
+		for (const auto &counts : blockCounts)
+			for (const auto &count : counts)
+				result[count.first] += count.second;
+
+		return result;
+
+	}
+
+	double calcExpectationValueZ(const ComplexArray &in_stateVec, long long in_numAmps, uint64_t in_zMask) {
+
+		// The parity of an index is split into the parity of its low RUN_BITS bits, tabulated once,
+		// and the parity of its high bits, constant over a run of RUN aligned amplitudes.
+		constexpr long long RUN_BITS = 8;
+		constexpr long long RUN = 1LL << RUN_BITS;
+		constexpr uint64_t LOW_MASK = RUN - 1;
+
+		alignas(64) double lowSigns[RUN];
+		for (long long o = 0; o < RUN; ++o)
+			lowSigns[o] = paritySign(o, in_zMask);
+
+		const qreal *re = in_stateVec.real;
+		const qreal *im = in_stateVec.imag;
+
+		return sumOverBlocks(in_numAmps, [&](long long in_begin, long long in_end) {
+
+			double sum = 0.0;
+			long long i = in_begin;
+
+			for (; i < in_end && (i & LOW_MASK); ++i)
+				sum += paritySign(i, in_zMask) * (re[i] * re[i] + im[i] * im[i]);
+
+			for (; i + RUN <= in_end; i += RUN) {
+				const qreal *runRe = re + i;
+				const qreal *runIm = im + i;
+				double runSum = 0.0;
+				#pragma omp simd reduction(+:runSum)
+				for (long long o = 0; o < RUN; ++o)
+					runSum += lowSigns[o] * (runRe[o] * runRe[o] + runIm[o] * runIm[o]);
+				sum += paritySign(i, in_zMask & ~LOW_MASK) * runSum;
+			}
+
+			for (; i < in_end; ++i)
+				sum += paritySign(i, in_zMask) * (re[i] * re[i] + im[i] * im[i]);
+
+			return sum;
+		});
+
+	}
+
+	double calcExpectationValuePauli(const Qureg &in_qreg, uint64_t in_xMask, uint64_t in_zMask) {
+		if (in_xMask == 0)
+			return calcExpectationValueZ(in_qreg.stateVec, in_qreg.numAmpsTotal, in_zMask);
+		return calcExpectationValuesPauli(in_qreg, {{in_xMask, in_zMask}})[0];
+	}
+
+	std::vector<double> calcExpectationValuesPauli(const Qureg &in_qreg, const std::vector<PauliString> &in_terms) {
+
+		const qreal *re = in_qreg.stateVec.real;
+		const qreal *im = in_qreg.stateVec.imag;
+		const long long numAmps = in_qreg.numAmpsTotal;
+
+		std::map<uint64_t, std::vector<size_t>> termsByFlipMask;
+		for (size_t i = 0; i < in_terms.size(); ++i)
+			termsByFlipMask[in_terms[i].xMask].push_back(i);
+
+		std::vector<double> result(in_terms.size(), 0.0);
+
+		for (const auto &group : termsByFlipMask) {
+
+			const uint64_t xMask = group.first;
+			const size_t nbTerms = group.second.size();
+
+			std::vector<uint64_t> zMasks(nbTerms);
+			for (size_t t = 0; t < nbTerms; ++t)
+				zMasks[t] = in_terms[group.second[t]].zMask;
+
+			std::vector<double> sums;
+
+			// Diagonal strings: only the Z phases remain.
+			if (xMask == 0) {
+				sums = sumOverBlocks(numAmps, nbTerms, [&](long long in_begin, long long in_end, double *io_sums) {
+					for (long long i = in_begin; i < in_end; ++i) {
+						const double prob = re[i] * re[i] + im[i] * im[i];
+						for (size_t t = 0; t < nbTerms; ++t)
+							io_sums[t] += paritySign(i, zMasks[t]) * prob;
+					}
+				});
+
+				for (size_t t = 0; t < nbTerms; ++t)
+					result[group.second[t]] = sums[t];
+				continue;
+			}
+
+			// P = i^nY X^x Z^z, hence <psi|P|psi> = i^nY sum_j conj(psi_{j^x}) (-1)^|j&z| psi_j.
+			// Pairing j with j^x leaves 2 Re(conj(psi_{j^x}) psi_j) for an even number of Y,
+			// and 2i Im(conj(psi_{j^x}) psi_j) for an odd one, with the overall phase folded into the sign.
+			std::vector<char> oddY(nbTerms);
+			std::vector<double> signs(nbTerms);
+			for (size_t t = 0; t < nbTerms; ++t) {
+				const int nbY = __builtin_popcountll(xMask & zMasks[t]);
+				oddY[t] = nbY % 2;
+				signs[t] = (nbY % 4 == 0 || nbY % 4 == 3) ? 2.0 : -2.0;
+			}
+
+			// Pairs are enumerated through the indices j having the highest flipped bit cleared.
+			const int pivot = 63 - __builtin_clzll(xMask);
+			const uint64_t lowMask = (1ULL << pivot) - 1;
+
+			sums = sumOverBlocks(numAmps / 2, nbTerms, [&](long long in_begin, long long in_end, double *io_sums) {
+				for (long long k = in_begin; k < in_end; ++k) {
+					const uint64_t j = ((k & ~lowMask) << 1) | (k & lowMask);
+					const uint64_t jFlip = j ^ xMask;
+					const double realPart = re[jFlip] * re[j] + im[jFlip] * im[j];
+					const double imagPart = re[jFlip] * im[j] - im[jFlip] * re[j];
+					for (size_t t = 0; t < nbTerms; ++t)
+						io_sums[t] += paritySign(j, zMasks[t]) * (oddY[t] ? imagPart : realPart);
+				}
+			});
+
+			for (size_t t = 0; t < nbTerms; ++t)
+				result[group.second[t]] = signs[t] * sums[t];
+		}
+
+		return result;
+
+	}
+
+	std::vector<double> calcJointProbabilities(const Qureg &in_qreg, const std::set<size_t> &in_bits) {
+
+		// Outcome of an index = outcome of its high bits (constant over a run of RUN aligned amplitudes)
+		// combined with the outcome of its low bits, tabulated once.
+		constexpr long long RUN_BITS = 8;
+		constexpr long long RUN = 1LL << RUN_BITS;
+		constexpr uint64_t LOW_MASK = RUN - 1;
+
+		uint64_t lowOutcomes[RUN];
+		for (long long o = 0; o < RUN; ++o)
+			lowOutcomes[o] = gatherBits(o, in_bits);
+
+		const qreal *re = in_qreg.stateVec.real;
+		const qreal *im = in_qreg.stateVec.imag;
+
+		return sumOverBlocks(in_qreg.numAmpsTotal, 1ULL << in_bits.size(), [&](long long in_begin, long long in_end, double *io_probs) {
+
+			long long i = in_begin;
+
+			for (; i < in_end && (i & LOW_MASK); ++i)
+				io_probs[gatherBits(i, in_bits)] += re[i] * re[i] + im[i] * im[i];
+
+			for (; i + RUN <= in_end; i += RUN) {
+				double *runProbs = io_probs + gatherBits(i, in_bits);
+				for (long long o = 0; o < RUN; ++o)
+					runProbs[lowOutcomes[o]] += re[i + o] * re[i + o] + im[i + o] * im[i + o];
+			}
+
+			for (; i < in_end; ++i)
+				io_probs[gatherBits(i, in_bits)] += re[i] * re[i] + im[i] * im[i];
+		});
+
+	}
+
+	void collapseToOutcome(Qureg &io_qreg, const std::set<size_t> &in_bits, uint64_t in_outcome, double in_probability) {
+
+		uint64_t mask = 0, value = 0;
+		int position = 0;
+		for (const auto &bitIdx : in_bits) {
+			mask |= 1ULL << bitIdx;
+			value |= ((in_outcome >> position++) & 1ULL) << bitIdx;
+		}
+
+		const qreal norm = 1.0 / std::sqrt(in_probability);
+		qreal *re = io_qreg.stateVec.real;
+		qreal *im = io_qreg.stateVec.imag;
+
+		#pragma omp parallel for simd schedule(static)
+		for (long long i = 0; i < io_qreg.numAmpsTotal; ++i) {
+			const qreal factor = ((uint64_t)i & mask) == value ? norm : 0.0;
+			re[i] *= factor;
+			im[i] *= factor;
+		}
+
+	}
+
+	void copyStateVector(const Qureg &in_source, Qureg &in_target) {
+
+		const long long numAmps = in_source.numAmpsTotal;
+		const long long nbBlocks = std::min(numAmps, NB_BLOCKS);
+		const long long blockSize = (numAmps + nbBlocks - 1) / nbBlocks;
+
+		#pragma omp parallel for schedule(static)
+		for (long long b = 0; b < nbBlocks; ++b) {
+			const long long begin = b * blockSize;
+			const long long count = std::min(numAmps, begin + blockSize) - begin;
+			if (count <= 0)
+				continue;
+			std::memcpy(in_target.stateVec.real + begin, in_source.stateVec.real + begin, count * sizeof(qreal));
+			std::memcpy(in_target.stateVec.imag + begin, in_source.stateVec.imag + begin, count * sizeof(qreal));
+		}
+
+	}
+
+	uint64_t gatherBits(uint64_t in_index, const std::set<size_t> &in_bits) {
+
+		uint64_t result = 0;
+		int position = 0;
+		for (const auto &bitIdx : in_bits)
+			result |= ((in_index >> bitIdx) & 1ULL) << position++;
+
+		return result;
+
+	}
+
+} // namespace kernels
+} // namespace quacc
@@ -0,0 +1,165 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#ifndef QUACC_STATE_VECTOR_KERNELS_HPP_
+#define QUACC_STATE_VECTOR_KERNELS_HPP_
+
+#include <complex>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "../../../../quacc/visitors/quest-default/QuEST/include/QuEST.h"
+
+namespace quacc {
+namespace kernels {
+
+	// Pauli string with X on the xMask-only bits, Z on the zMask-only bits and Y on the bits set in both.
+	struct PauliString {
+		uint64_t xMask;
+		uint64_t zMask;
+	};
+
+	// Phase in_angle picked up by the basis states having all the in_mask bits set.
+	// in_mask has at most two bits, an empty mask being a global phase.
+	struct PhaseTerm {
+		uint64_t mask;
+		double angle;
+	};
+
+	// Multiplies every amplitude by exp(i * sum of the angles of the in_nbTerms in_terms it matches),
+	// i.e. applies a whole run of diagonal gates in one pass over the amplitudes.
+	void applyPhaseTerms(Qureg &io_qreg, const PhaseTerm *in_terms, size_t in_nbTerms);
+
+	// The phases of a run of terms, tabulated by preparePhaseTerms() for registers of a given number of qubits,
+	// so that applyPhaseTable() applies them to many such registers (e.g. the tiles of a layer) at the cost of one.
+	struct PhaseTable {
+		// Bits of the amplitude indices the table covers, 64 KB of factors
+		static constexpr int LOW_BITS = 12;
+		int lowBits;
+		std::vector<std::complex<double>> lowTable;
+		std::vector<PhaseTerm> highTerms;
+		// Per low bit, the terms it shares with a high bit, on the high bit
+		std::vector<std::vector<PhaseTerm>> crossTerms;
+		bool hasCrossTerms;
+	};
+
+	PhaseTable preparePhaseTerms(const PhaseTerm *in_terms, size_t in_nbTerms, int in_nbQubits);
+	void applyPhaseTable(Qureg &io_qreg, const PhaseTable &in_table);
+
+	// Applies the 2^k x 2^k row-major in_matrix, not necessarily unitary, on the in_nbTargets qubits
+	// in_targets (in_targets[0] being the least significant bit of the matrix indices).
+	void applyMatrix(Qureg &io_qreg, const int *in_targets, int in_nbTargets, const std::complex<double> *in_matrix);
+
+	// Offsets of the amplitudes a matrix on given targets mixes, computed once by prepareMatrix() for many registers
+	struct MatrixLayout {
+		std::vector<int> targets;
+		std::vector<int> sortedTargets;
+		std::vector<long long> offsets;
+	};
+
+	MatrixLayout prepareMatrix(const int *in_targets, int in_nbTargets);
+	// As above on the targets of in_layout, in the calling thread only, with io_scratch of 2^k amplitudes.
+	void applyMatrix(Qureg &io_qreg, const MatrixLayout &in_layout, const std::complex<double> *in_matrix, std::complex<double> *io_scratch);
+
+	// Qubits below LOW_QUBITS have kernels of their own, specialized at compile time on the qubit indices:
+	// the amplitudes a gate on them mixes lie within blocks of 2^LOW_QUBITS consecutive ones, at constant
+	// positions. These kernels require a register of at least LOW_QUBITS qubits.
+	constexpr int LOW_QUBITS = 4;
+
+	// 2x2 row-major in_matrix on in_target < LOW_QUBITS
+	void applyMatrix1Low(Qureg &io_qreg, int in_target, const std::complex<double> *in_matrix);
+
+	// 2x2 in_matrix on in_target, applied to the amplitudes having the in_control bit set, both below LOW_QUBITS
+	void applyControlledMatrix1Low(Qureg &io_qreg, int in_control, int in_target, const std::complex<double> *in_matrix);
+
+	// 4x4 in_matrix on in_qubit0 (the least significant bit of the matrix indices) and in_qubit1, both below LOW_QUBITS
+	void applyMatrix2Low(Qureg &io_qreg, int in_qubit0, int in_qubit1, const std::complex<double> *in_matrix);
+
+	// Permutation of the basis states having all the controlMask bits set: flips their flipMask bits
+	// (X, CNOT, Toffoli, multi-controlled X), or exchanges their two swapMask bits (Swap, controlled Swap).
+	// Such gates only move amplitudes around, without any floating-point work.
+	struct BitPermutation {
+		uint64_t controlMask;
+		uint64_t flipMask;
+		uint64_t swapMask;
+	};
+
+	// Applies in_permutation in place, by exchanging the pairs of amplitudes it maps onto each other.
+	void applyBitPermutation(Qureg &io_qreg, const BitPermutation &in_permutation);
+
+	// Applies the in_nbPermutations in_permutations, in order, in a single pass: the composed permutation
+	// is resolved per index and applied in place, along its cycles, every amplitude being moved once.
+	void applyBitPermutations(Qureg &io_qreg, const BitPermutation *in_permutations, size_t in_nbPermutations);
+
+	// out_qreg = sum of in_coefficients[t] * in_terms[t] applied to in_qreg, out_qreg being another register of the same size.
+	void applyPauliSum(const Qureg &in_qreg, Qureg &out_qreg, const std::vector<PauliString> &in_terms, const std::vector<double> &in_coefficients);
+
+	// Re(<in_bra|in_ket>), deterministic as the other reductions.
+	double calcInnerProductReal(const Qureg &in_bra, const Qureg &in_ket);
+
+	// Draws in_shots basis states from the |amplitude|^2 distribution of the state vector,
+	// without collapsing it. Returns the number of times each basis state index was drawn.
+	std::map<uint64_t, int> sampleBasisStates(const Qureg &in_qreg, int in_shots, std::mt19937_64 &in_rng);
+
+	// <psi|Z...Z|psi> over the in_zMask bits, i.e. the parity expectation of those qubits.
+	// Vectorized and parallel, the result does not depend on the number of threads.
+	double calcExpectationValueZ(const ComplexArray &in_stateVec, long long in_numAmps, uint64_t in_zMask);
+
+	// <psi|P|psi> for the Pauli string P, computed in one read-only pass over the amplitudes.
+	double calcExpectationValuePauli(const Qureg &in_qreg, uint64_t in_xMask, uint64_t in_zMask);
+
+	// <psi|P|psi> for every Pauli string of in_terms. Terms sharing the same flip mask only differ by
+	// their phases, so they are evaluated together: one pass over the amplitudes per distinct xMask.
+	std::vector<double> calcExpectationValuesPauli(const Qureg &in_qreg, const std::vector<PauliString> &in_terms);
+
+	// Largest number of measured qubits the joint distribution is tabulated for.
+	constexpr size_t MAX_JOINT_BITS = 16;
+
+	// Joint probability distribution of the in_bits qubits (at most MAX_JOINT_BITS of them),
+	// indexed as gatherBits() packs them. Computed in one read-only pass over the amplitudes.
+	std::vector<double> calcJointProbabilities(const Qureg &in_qreg, const std::set<size_t> &in_bits);
+
+	// Projects the state onto in_outcome of the in_bits qubits (packed as gatherBits() does)
+	// and renormalizes it, in_probability being the probability of that outcome.
+	void collapseToOutcome(Qureg &io_qreg, const std::set<size_t> &in_bits, uint64_t in_outcome, double in_probability);
+
+	// Copies the amplitudes of in_source into in_target (of the same size) with a parallel bulk copy.
+	void copyStateVector(const Qureg &in_source, Qureg &in_target);
+
+	// Packs the in_bits bits of in_index into a contiguous integer,
+	// the lowest qubit of in_bits becoming bit 0.
+	uint64_t gatherBits(uint64_t in_index, const std::set<size_t> &in_bits);
+
+} // namespace kernels
+} // namespace quacc
+
+#endif /* QUACC_STATE_VECTOR_KERNELS_HPP_ */
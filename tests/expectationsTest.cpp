@@ -30,7 +30,63 @@
 #include <iostream>
 #include <gtest/gtest.h>
 #include "xacc.hpp"
+#include "Quacc.hpp"
+#include "StateVectorKernels.hpp"
 #include <cmath>
+#include <random>
+
+// Gradient of <observable> in the state kernel prepares at parameters, computed by qpu, and the expectation value
+std::vector<double> computeGradient(std::shared_ptr<xacc::Accelerator> qpu, std::shared_ptr<xacc::CompositeInstruction> kernel,
+		const std::vector<double>& parameters, std::shared_ptr<xacc::Observable> observable, double& value){
+
+	auto quacc = std::dynamic_pointer_cast<quacc::Quacc>(qpu);
+	EXPECT_TRUE(quacc);
+
+	auto qubitReg = xacc::qalloc(kernel->nPhysicalBits());
+	quacc->computeGradient(qubitReg, kernel, parameters, observable);
+	value = qubitReg->getInformation("exp-val").as<double>();
+	return qubitReg->getInformation("gradient").as<std::vector<double>>();
+
+}
+
+// Same gradient, by central finite differences of the expectation value
+std::vector<double> finiteDifferences(std::shared_ptr<xacc::Accelerator> qpu, std::shared_ptr<xacc::CompositeInstruction> kernel,
+		const std::vector<double>& parameters, std::shared_ptr<xacc::Observable> observable){
+
+	const double step = 1e-4;
+	std::vector<double> gradient;
+	for(size_t i = 0; i < parameters.size(); ++i){
+		auto shifted = parameters;
+		double forward, backward;
+		shifted[i] = parameters[i] + step;
+		computeGradient(qpu, kernel, shifted, observable, forward);
+		shifted[i] = parameters[i] - step;
+		computeGradient(qpu, kernel, shifted, observable, backward);
+		gradient.push_back((forward - backward) / (2 * step));
+	}
+	return gradient;
+
+}
+
+// Kernel whose first variable drives several gates through affine parameters, U and CPhase included
+std::shared_ptr<xacc::CompositeInstruction> gradientAnsatz(std::shared_ptr<xacc::Accelerator> qpu){
+
+	auto compiler = xacc::getCompiler("xasm");
+	auto ir = compiler->compile(R"(__qpu__ void gradientAnsatz(qbit q, double t0, double t1) {
+		H(q[2]);
+		Ry(q[0], t0);
+		Rx(q[1], 2 * t0 + 0.3);
+		CNOT(q[0], q[1]);
+		U(q[1], t1, 0.4, t0);
+		CPhase(q[0], q[1], t1 - t0);
+		CNOT(q[2], q[0]);
+		Rz(q[0], 0.5 * t1);
+		Ry(q[2], -t0);
+	})", qpu);
+
+	return ir->getComposite("gradientAnsatz");
+
+}
 
 TEST(expectationTest, getExpectationValueZ){
 
@@ -51,6 +107,155 @@ TEST(expectationTest, getExpectationValueZ){
 
 }
 
+TEST(expectationTest, vqeMode){
+
+	auto qubitReg = xacc::qalloc(2);
+	auto qpu = xacc::getAccelerator("quest");
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void ansatz(qbit q, double theta) {
+		Ry(q[0], theta);
+		CNOT(q[0], q[1]);
+	})", qpu);
+
+	auto program = ir->getComposite("ansatz");
+	auto evalved = program -> operator ()({M_PI/3});
+
+	auto observable = xacc::quantum::getObservable("pauli", std::string("X0 X1 + Y0 Y1 + Z0 Z1 + Z1"));
+	auto functions = observable->observe(evalved);
+
+	qpu->execute(qubitReg, functions);
+
+	// cos(theta/2)|00> + sin(theta/2)|11>
+	std::map<std::string, double> expected = {{"X0X1", sqrt(3)/2}, {"Y0Y1", -sqrt(3)/2}, {"Z0Z1", 1.}, {"Z1", 1./2}};
+
+	ASSERT_EQ(qubitReg->getChildren().size(), expected.size());
+	for(auto &child: qubitReg->getChildren())
+		ASSERT_NEAR(child->getExpectationValueZ(), expected[child->name()], 1e-6);
+
+}
+
+TEST(expectationTest, groupedPauliTerms){
+
+	// Terms sharing the X/Y flip pattern of qubits 0 and 1 are evaluated in a single pass.
+	auto qubitReg = xacc::qalloc(3);
+	auto qpu = xacc::getAccelerator("quest");
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void ansatz(qbit q, double theta) {
+		Ry(q[0], theta);
+		CNOT(q[0], q[1]);
+		X(q[2]);
+	})", qpu);
+
+	auto program = ir->getComposite("ansatz");
+	auto evalved = program -> operator ()({M_PI/3});
+
+	auto observable = xacc::quantum::getObservable("pauli", std::string("X0 X1 + X0 X1 Z2 + Y0 Y1 + Y0 Y1 Z2 + X0 Y1"));
+	auto functions = observable->observe(evalved);
+
+	qpu->execute(qubitReg, functions);
+
+	std::map<std::string, double> expected = {{"X0X1", sqrt(3)/2}, {"X0X1Z2", -sqrt(3)/2}, {"Y0Y1", -sqrt(3)/2},
+											  {"Y0Y1Z2", sqrt(3)/2}, {"X0Y1", 0.}};
+
+	ASSERT_EQ(qubitReg->getChildren().size(), expected.size());
+	for(auto &child: qubitReg->getChildren())
+		ASSERT_NEAR(child->getExpectationValueZ(), expected[child->name()], 1e-6);
+
+}
+
+TEST(expectationTest, adjointGradient){
+
+	auto qpu = xacc::getAccelerator("quest", {std::make_pair("gradient-method", std::string("adjoint"))});
+	auto program = gradientAnsatz(qpu);
+	auto observable = xacc::quantum::getObservable("pauli", std::string("0.4 + Z0 Z1 + 0.7 X1 + 0.3 Y0 Z2 - 1.1 X0 X1 X2"));
+
+	for(const auto& parameters : std::vector<std::vector<double>>{{0.3, -0.8}, {1.9, 2.4}}){
+
+		double value;
+		const auto gradient = computeGradient(qpu, program, parameters, observable, value);
+		const auto expected = finiteDifferences(qpu, program, parameters, observable);
+
+		ASSERT_EQ(gradient.size(), parameters.size());
+		for(size_t i = 0; i < parameters.size(); ++i)
+			ASSERT_NEAR(gradient[i], expected[i], 1e-5);
+
+	}
+
+}
+
+TEST(expectationTest, parameterShiftGradient){
+
+	auto observable = xacc::quantum::getObservable("pauli", std::string("0.4 + Z0 Z1 + 0.7 X1 + 0.3 Y0 Z2 - 1.1 X0 X1 X2"));
+	const std::vector<double> parameters{0.7, -1.3};
+
+	// The shifted circuits spread over a single worker, then over several of them
+	for(const int threads : {1, 3}){
+
+		auto qpu = xacc::getAccelerator("quest", {std::make_pair("gradient-method", std::string("parameter-shift")),
+												  std::make_pair("gradient-threads", threads)});
+		auto program = gradientAnsatz(qpu);
+
+		double value;
+		const auto gradient = computeGradient(qpu, program, parameters, observable, value);
+		ASSERT_EQ(qpu->getExecutionInfo().get<int>("gradient-threads"), threads);
+		const auto expected = finiteDifferences(qpu, program, parameters, observable);
+
+		ASSERT_EQ(gradient.size(), parameters.size());
+		for(size_t i = 0; i < parameters.size(); ++i)
+			ASSERT_NEAR(gradient[i], expected[i], 1e-5);
+
+	}
+
+}
+
+TEST(expectationTest, zParityKernel){
+
+	// Wider than the runs of amplitudes the kernel tabulates the parities of
+	const int nbQubits = 11;
+	QuESTEnv env = createQuESTEnv();
+	Qureg qreg = createQureg(nbQubits, env);
+	Qureg workspace = createQureg(nbQubits, env);
+
+	std::mt19937_64 rng(7);
+	std::normal_distribution<double> normal;
+	std::vector<qreal> real(1LL << nbQubits), imag(1LL << nbQubits);
+	double norm = 0.0;
+	for(size_t i = 0; i < real.size(); ++i){
+		real[i] = normal(rng);
+		imag[i] = normal(rng);
+		norm += real[i] * real[i] + imag[i] * imag[i];
+	}
+	for(size_t i = 0; i < real.size(); ++i){
+		real[i] /= std::sqrt(norm);
+		imag[i] /= std::sqrt(norm);
+	}
+	setAmps(qreg, 0, real.data(), imag.data(), real.size());
+
+	// Every single qubit, the highest one included
+	for(int qubit = 0; qubit < nbQubits; ++qubit)
+		ASSERT_NEAR(quacc::kernels::calcExpectationValueZ(qreg.stateVec, qreg.numAmpsTotal, 1ULL << qubit),
+					1 - 2 * calcProbOfOutcome(qreg, qubit, 1), 1e-10);
+
+	// Products of odd and even qubits, within and across the tabulated low bits
+	for(const auto& qubits : std::vector<std::vector<int>>{{0, 1}, {1, 3, 5}, {2, 7}, {0, nbQubits - 1}, {5, 8, nbQubits - 1},
+														   {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10}}){
+		uint64_t zMask = 0;
+		for(const auto& qubit : qubits)
+			zMask |= 1ULL << qubit;
+		std::vector<int> targets(qubits);
+		std::vector<enum pauliOpType> codes(qubits.size(), PAULI_Z);
+		ASSERT_NEAR(quacc::kernels::calcExpectationValueZ(qreg.stateVec, qreg.numAmpsTotal, zMask),
+					calcExpecPauliProd(qreg, targets.data(), codes.data(), qubits.size(), workspace), 1e-10);
+	}
+
+	destroyQureg(workspace, env);
+	destroyQureg(qreg, env);
+	destroyQuESTEnv(env);
+
+}
+
 int main(int argc, char **argv) {
 
 	xacc::Initialize();
@@ -30,6 +30,7 @@
 #include <iostream>
 #include <gtest/gtest.h>
 #include "xacc.hpp"
+#include "Quacc.hpp"
 #include <cmath>
 
 bool differs(double a, double b){
@@ -65,6 +66,40 @@ bool stateVectorEq(std::vector<double> &realA, std::vector<double> &imagA, std::
 
 }
 
+// Executes the kernels of sources one after the other on the same buffer of nbQubits qubits, with the accelerator
+// configured with referenceOptions and then with options, expecting both to leave the same state after each kernel.
+// Returns the accelerator configured with options, for the execution info of the last kernel.
+std::shared_ptr<xacc::Accelerator> compareWithReference(const std::vector<std::string> &sources, int nbQubits,
+		const xacc::HeterogeneousMap &referenceOptions, const xacc::HeterogeneousMap &options){
+
+	auto compiler = xacc::getCompiler("xasm");
+	auto referenceReg = xacc::qalloc(nbQubits);
+	auto qubitReg = xacc::qalloc(nbQubits);
+	std::shared_ptr<xacc::Accelerator> qpu;
+
+	for(const auto &source : sources){
+
+		auto referenceQpu = xacc::getAccelerator("quest", referenceOptions);
+		auto program = compiler->compile(source, referenceQpu)->getComposites().front();
+		referenceQpu->execute(referenceReg, program);
+
+		std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+		std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+		qpu = xacc::getAccelerator("quest", options);
+		qpu->execute(qubitReg, program);
+
+		std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+		std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+		EXPECT_TRUE(stateVectorEq(statevect_real, statevect_imag, reference_real, reference_imag)) << source;
+
+	}
+
+	return qpu;
+
+}
+
 /*00: 1 0 0 0
  *01: 0 1 0 0 X(q[0])
  *10: 0 0 1 0 X(q[1])
@@ -456,6 +491,708 @@ TEST (gateTest, CPhase) {
 
 }
 
+TEST (gateTest, fusedGates) {
+
+	const std::string source = R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		Rx(q[0], 0.3);
+		Ry(q[1], 1.1);
+		Z(q[0]);
+		CNOT(q[0], q[1]);
+		Rz(q[1], 0.7);
+		U(q[1], 0.2, 0.4, 0.6);
+		Y(q[0]);
+		CPhase(q[1], q[0], 0.5);
+		H(q[2]);
+		CZ(q[2], q[3]);
+		Swap(q[1], q[2]);
+		Rx(q[3], 0.9);
+		CNOT(q[3], q[0]);
+		H(q[1]);
+	})";
+
+	for(int maxQubits = 1; maxQubits <= 4; ++maxQubits)
+		compareWithReference({source}, 4, {std::make_pair("gate-fusion", false)}, {std::make_pair("fusion-max-qubits", maxQubits)});
+
+}
+
+TEST (gateTest, diagonalRun) {
+
+	auto referenceQpu = xacc::getAccelerator("quest", {std::make_pair("gate-fusion", false), std::make_pair("diagonal-accumulation", false)});
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		H(q[1]);
+		H(q[2]);
+		H(q[3]);
+		CPhase(q[0], q[1], 0.4);
+		Rz(q[1], 0.3);
+		CZ(q[1], q[2]);
+		Z(q[3]);
+		CPhase(q[2], q[3], -1.2);
+		Rz(q[0], 0.8);
+		CPhase(q[3], q[0], 0.6);
+		Rx(q[1], 0.5);
+		Rz(q[1], 0.2);
+		CZ(q[0], q[2]);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("test");
+
+	auto referenceReg = xacc::qalloc(4);
+	referenceQpu->execute(referenceReg, program);
+
+	std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	auto qpu = xacc::getAccelerator("quest", {std::make_pair("gate-fusion", false)});
+	auto qubitReg = xacc::qalloc(4);
+	qpu->execute(qubitReg, program);
+
+	std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_TRUE(stateVectorEq(statevect_real, statevect_imag, reference_real, reference_imag));
+
+}
+
+TEST (gateTest, cachedTape) {
+
+	auto qpu = xacc::getAccelerator("quest");
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		Ry(q[1], 0.7);
+		CNOT(q[0], q[2]);
+		CPhase(q[2], q[1], 0.3);
+		Rz(q[0], 1.2);
+		CZ(q[0], q[1]);
+		Swap(q[1], q[2]);
+	})", qpu);
+
+	auto program = ir->getComposite("test");
+
+	auto firstReg = xacc::qalloc(3);
+	qpu->execute(firstReg, program);
+	const int hits = qpu->getExecutionInfo().get<int>("tape-cache-hits");
+
+	// Same circuit again, replayed from the compiled tape
+	auto secondReg = xacc::qalloc(3);
+	qpu->execute(secondReg, program);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("tape-cache-hits"), hits + 1);
+
+	std::vector<double> first_real = firstReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> first_imag = firstReg->getInformation("statevect_imag").as<std::vector<double>>();
+	std::vector<double> second_real = secondReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> second_imag = secondReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_TRUE(stateVectorEq(first_real, first_imag, second_real, second_imag));
+
+}
+
+TEST (gateTest, quregPool) {
+
+	auto qpu = xacc::getAccelerator("quest");
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		CNOT(q[0], q[1]);
+		CNOT(q[1], q[2]);
+		CNOT(q[2], q[3]);
+		CNOT(q[3], q[4]);
+		CNOT(q[4], q[5]);
+		CNOT(q[5], q[6]);
+	})", qpu);
+
+	auto program = ir->getComposite("test");
+
+	// Empty the pool of whatever registers the previous tests left in it
+	qpu->initialize({{"qureg-pool-mb", 0}});
+	qpu->execute(xacc::qalloc(7), program);
+	qpu->initialize({{"qureg-pool-mb", 1}});
+
+	// A register of a new size is created
+	const int hits = qpu->getExecutionInfo().get<int>("qureg-pool-hits");
+	const int misses = qpu->getExecutionInfo().get<int>("qureg-pool-misses");
+	qpu->execute(xacc::qalloc(7), program);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("qureg-pool-hits"), hits);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("qureg-pool-misses"), misses + 1);
+
+	// and then reused by the next execution of the same size
+	auto qubitReg = xacc::qalloc(7);
+	qpu->execute(qubitReg, program);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("qureg-pool-hits"), hits + 1);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("qureg-pool-misses"), misses + 1);
+
+	// The pooled register is handed back in the zero state
+	std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+	ASSERT_NEAR(statevect_real[0], 1 / std::sqrt(2), 1e-6);
+	ASSERT_NEAR(statevect_real[127], 1 / std::sqrt(2), 1e-6);
+
+	// A register of another size is not (all of its qubits in use, so that none is compacted away)
+	auto wider = compiler->compile(R"(__qpu__ void wider(qbit q) {
+		H(q[0]);
+		CNOT(q[0], q[1]);
+		CNOT(q[1], q[2]);
+		CNOT(q[2], q[3]);
+		CNOT(q[3], q[4]);
+		CNOT(q[4], q[5]);
+		CNOT(q[5], q[6]);
+		CNOT(q[6], q[7]);
+	})", qpu)->getComposite("wider");
+	qpu->execute(xacc::qalloc(8), wider);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("qureg-pool-hits"), hits + 1);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("qureg-pool-misses"), misses + 2);
+
+	qpu->initialize({{"qureg-pool-mb", 1024}});
+
+}
+
+TEST (gateTest, nativeBackend) {
+
+	auto referenceQpu = xacc::getAccelerator("quest");
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		Rx(q[0], 0.3);
+		Ry(q[1], 1.1);
+		Z(q[0]);
+		CNOT(q[0], q[1]);
+		Rz(q[1], 0.7);
+		U(q[1], 0.2, 0.4, 0.6);
+		Y(q[0]);
+		CPhase(q[1], q[0], 0.5);
+		H(q[2]);
+		CZ(q[2], q[3]);
+		Swap(q[1], q[2]);
+		Rx(q[3], 0.9);
+		CNOT(q[3], q[0]);
+		H(q[1]);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("test");
+
+	auto referenceReg = xacc::qalloc(4);
+	referenceQpu->execute(referenceReg, program);
+
+	std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	// The widest kernels the CPU supports, then the baseline ones
+	for(const std::string simdPath : {"auto", "scalar"}){
+
+		auto nativeQpu = xacc::getAccelerator("quest", {std::make_pair("backend", std::string("quacc-native")),
+														std::make_pair("simd-path", simdPath)});
+		auto nativeReg = xacc::qalloc(4);
+		nativeQpu->execute(nativeReg, program);
+		ASSERT_EQ(nativeQpu->getExecutionInfo().getString("visitor"), "quacc-native");
+		if(simdPath != "auto")
+			ASSERT_EQ(nativeQpu->getExecutionInfo().getString("simd-path"), simdPath);
+
+		std::vector<double> native_real = nativeReg->getInformation("statevect_real").as<std::vector<double>>();
+		std::vector<double> native_imag = nativeReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+		ASSERT_TRUE(stateVectorEq(native_real, native_imag, reference_real, reference_imag));
+
+	}
+
+}
+
+TEST (gateTest, nativeIdleQubits) {
+
+	auto referenceQpu = xacc::getAccelerator("quest");
+	auto compiler = xacc::getCompiler("xasm");
+
+	// Qubits 0 and 2 are never used
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[1]);
+		Ry(q[3], 0.8);
+		CNOT(q[1], q[3]);
+		Rz(q[3], 0.4);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("test");
+
+	auto referenceReg = xacc::qalloc(4);
+	referenceQpu->execute(referenceReg, program);
+
+	std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	// The native visitor simulates the active qubits only too, and reports the state on all of them
+	auto nativeQpu = xacc::getAccelerator("quest", {std::make_pair("backend", std::string("quacc-native"))});
+	auto nativeReg = xacc::qalloc(4);
+	nativeQpu->execute(nativeReg, program);
+	ASSERT_EQ(nativeQpu->getExecutionInfo().get<int>("register-qubits"), 2);
+
+	std::vector<double> native_real = nativeReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> native_imag = nativeReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_TRUE(stateVectorEq(native_real, native_imag, reference_real, reference_imag));
+
+}
+
+TEST (gateTest, lowQubitGates) {
+
+	// Gates on qubits 0-3 go through the low qubit kernels, those on qubit 4 through QuEST
+	auto qpu = xacc::getAccelerator("quest", {std::make_pair("gate-fusion", false), std::make_pair("diagonal-accumulation", false)});
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		H(q[3]);
+		Rx(q[1], 0.3);
+		Ry(q[2], 1.1);
+		U(q[3], 0.2, 0.4, 0.6);
+		CNOT(q[3], q[0]);
+		CNOT(q[1], q[2]);
+		CZ(q[0], q[2]);
+		CPhase(q[2], q[1], 0.5);
+		Swap(q[3], q[1]);
+		Rz(q[0], 0.7);
+		Y(q[2]);
+		H(q[4]);
+		CNOT(q[4], q[1]);
+		Swap(q[0], q[4]);
+		X(q[3]);
+		Z(q[1]);
+	})", qpu);
+
+	auto program = ir->getComposite("test");
+
+	auto qubitReg = xacc::qalloc(5);
+	qpu->execute(qubitReg, program);
+
+	std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	auto nativeQpu = xacc::getAccelerator("quest", {std::make_pair("backend", std::string("quacc-native"))});
+	auto nativeReg = xacc::qalloc(5);
+	nativeQpu->execute(nativeReg, program);
+
+	std::vector<double> native_real = nativeReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> native_imag = nativeReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_TRUE(stateVectorEq(statevect_real, statevect_imag, native_real, native_imag));
+
+}
+
+TEST (gateTest, permutationRun) {
+
+	auto referenceQpu = xacc::getAccelerator("quest", {std::make_pair("gate-fusion", false), std::make_pair("permutation-composition", false)});
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		Ry(q[1], 0.4);
+		Rx(q[2], 1.3);
+		U(q[3], 0.2, 0.9, -0.5);
+		H(q[4]);
+		CNOT(q[0], q[3]);
+		X(q[1]);
+		Swap(q[2], q[4]);
+		CNOT(q[4], q[1]);
+		Swap(q[0], q[1]);
+		X(q[3]);
+		CNOT(q[3], q[2]);
+		Rz(q[1], 0.6);
+		CNOT(q[2], q[0]);
+		Swap(q[4], q[3]);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("test");
+
+	auto referenceReg = xacc::qalloc(5);
+	referenceQpu->execute(referenceReg, program);
+
+	std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	auto qpu = xacc::getAccelerator("quest");
+	auto qubitReg = xacc::qalloc(5);
+	qpu->execute(qubitReg, program);
+	ASSERT_GE(qpu->getExecutionInfo().get<int>("permutation-runs"), 1);
+
+	std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_TRUE(stateVectorEq(statevect_real, statevect_imag, reference_real, reference_imag));
+
+}
+
+TEST (gateTest, swapRelabeling) {
+
+	auto referenceQpu = xacc::getAccelerator("quest", {std::make_pair("swap-relabeling", false)});
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		Ry(q[1], 0.8);
+		Rx(q[3], -0.4);
+		Swap(q[0], q[2]);
+		CNOT(q[2], q[1]);
+		Swap(q[1], q[3]);
+		Swap(q[2], q[3]);
+		CPhase(q[3], q[0], 0.7);
+		U(q[1], 0.3, 0.5, 1.1);
+		Swap(q[0], q[1]);
+		Rz(q[0], 0.2);
+		CZ(q[1], q[2]);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("test");
+
+	auto referenceReg = xacc::qalloc(4);
+	referenceQpu->execute(referenceReg, program);
+
+	std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	auto qpu = xacc::getAccelerator("quest");
+	auto qubitReg = xacc::qalloc(4);
+	qpu->execute(qubitReg, program);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("relabeled-swaps"), 4);
+
+	std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_TRUE(stateVectorEq(statevect_real, statevect_imag, reference_real, reference_imag));
+
+}
+
+TEST (gateTest, cacheBlockedWindows) {
+
+	auto referenceQpu = xacc::getAccelerator("quest", {std::make_pair("cache-block-qubits", 0)});
+	auto compiler = xacc::getCompiler("xasm");
+
+	// Blocks of 2^4 amplitudes: the gates on qubits 0-3 are applied in windows, block by block,
+	// and qubit 7, used by most of the last gates, is moved below the blocks.
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		H(q[1]);
+		Ry(q[2], 0.6);
+		CNOT(q[0], q[3]);
+		CPhase(q[1], q[2], 0.9);
+		H(q[7]);
+		U(q[3], 0.4, -0.2, 0.8);
+		Rx(q[0], 1.2);
+		CZ(q[2], q[3]);
+		CNOT(q[5], q[8]);
+		Rz(q[1], -0.5);
+		CNOT(q[7], q[0]);
+		Ry(q[7], 0.3);
+		CPhase(q[7], q[2], 0.4);
+		Rx(q[7], -0.7);
+		CNOT(q[1], q[7]);
+		H(q[6]);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("test");
+
+	auto referenceReg = xacc::qalloc(9);
+	referenceQpu->execute(referenceReg, program);
+
+	std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	auto qpu = xacc::getAccelerator("quest", {std::make_pair("cache-block-qubits", 4), std::make_pair("fusion-max-qubits", 1)});
+	auto qubitReg = xacc::qalloc(9);
+	qpu->execute(qubitReg, program);
+	ASSERT_GE(qpu->getExecutionInfo().get<int>("cache-windows"), 1);
+
+	std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_TRUE(stateVectorEq(statevect_real, statevect_imag, reference_real, reference_imag));
+
+}
+
+TEST (gateTest, qubitOrdering) {
+
+	// On all the qubits of the buffer, some of them being idle
+	auto referenceQpu = xacc::getAccelerator("quest", {std::make_pair("qubit-ordering", false), std::make_pair("idle-qubit-compaction", false)});
+	auto compiler = xacc::getCompiler("xasm");
+
+	// Most gates target qubits 8 and 9, which the ordering moves to the lowest indices
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		H(q[8]);
+		Ry(q[9], 0.7);
+		CNOT(q[8], q[9]);
+		Rx(q[8], -0.3);
+		U(q[9], 0.4, 1.1, -0.6);
+		CNOT(q[0], q[8]);
+		Ry(q[8], 1.3);
+		CNOT(q[9], q[5]);
+		Rx(q[9], 0.2);
+		H(q[8]);
+		CPhase(q[8], q[9], 0.5);
+		Ry(q[9], -0.9);
+		CNOT(q[2], q[9]);
+		Rx(q[8], 0.6);
+		U(q[8], -0.2, 0.3, 0.8);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("test");
+
+	auto referenceReg = xacc::qalloc(10);
+	referenceQpu->execute(referenceReg, program);
+
+	std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	auto qpu = xacc::getAccelerator("quest", {std::make_pair("idle-qubit-compaction", false)});
+	auto qubitReg = xacc::qalloc(10);
+	qpu->execute(qubitReg, program);
+	ASSERT_GT(qpu->getExecutionInfo().get<int>("reordered-qubits"), 0);
+
+	std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_TRUE(stateVectorEq(statevect_real, statevect_imag, reference_real, reference_imag));
+
+}
+
+TEST (gateTest, layerSweeps) {
+
+	auto referenceQpu = xacc::getAccelerator("quest", {std::make_pair("layer-max-qubits", 0), std::make_pair("cache-block-qubits", 0),
+			std::make_pair("idle-qubit-compaction", false)});
+	auto compiler = xacc::getCompiler("xasm");
+
+	// Brickwork layers on the highest qubits, each applied in a single sweep over tiles of the state
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		Ry(q[8], 0.3);
+		Ry(q[9], -0.8);
+		Ry(q[10], 1.1);
+		Ry(q[11], 0.5);
+		Ry(q[12], -0.2);
+		Ry(q[13], 0.9);
+		CNOT(q[8], q[9]);
+		CNOT(q[10], q[11]);
+		CNOT(q[12], q[13]);
+		CPhase(q[9], q[10], 0.4);
+		CNOT(q[11], q[12]);
+		Rx(q[13], 0.7);
+		Rz(q[8], -0.6);
+		U(q[10], 0.2, 0.5, -1.3);
+		CNOT(q[0], q[13]);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("test");
+
+	auto referenceReg = xacc::qalloc(14);
+	referenceQpu->execute(referenceReg, program);
+
+	std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	auto qpu = xacc::getAccelerator("quest", {std::make_pair("cache-block-qubits", 0), std::make_pair("idle-qubit-compaction", false)});
+	auto qubitReg = xacc::qalloc(14);
+	qpu->execute(qubitReg, program);
+	ASSERT_GE(qpu->getExecutionInfo().get<int>("layers"), 1);
+
+	std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_TRUE(stateVectorEq(statevect_real, statevect_imag, reference_real, reference_imag));
+
+}
+
+TEST (gateTest, idleQubitCompaction) {
+
+	auto referenceQpu = xacc::getAccelerator("quest", {std::make_pair("idle-qubit-compaction", false)});
+	auto compiler = xacc::getCompiler("xasm");
+
+	// Qubits 0, 2 and 5 are never used: the register only holds the other three
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[1]);
+		Ry(q[3], 0.6);
+		CNOT(q[1], q[4]);
+		CPhase(q[3], q[4], -0.8);
+		U(q[1], 0.5, 0.2, -0.4);
+		Swap(q[3], q[1]);
+		Rx(q[4], 1.1);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("test");
+
+	auto referenceReg = xacc::qalloc(6);
+	referenceQpu->execute(referenceReg, program);
+
+	std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	auto qpu = xacc::getAccelerator("quest");
+	auto qubitReg = xacc::qalloc(6);
+	qpu->execute(qubitReg, program);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("register-qubits"), 3);
+
+	std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+	std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+	ASSERT_EQ(statevect_real.size(), 64);
+	ASSERT_TRUE(stateVectorEq(statevect_real, statevect_imag, reference_real, reference_imag));
+
+}
+
+TEST (gateTest, compactionRestored) {
+
+	auto compiler = xacc::getCompiler("xasm");
+
+	// Qubits 0 and 2 are never used
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q) {
+		H(q[1]);
+		CNOT(q[1], q[3]);
+	})", xacc::getAccelerator("quest"));
+
+	auto program = ir->getComposite("test");
+
+	auto uncompactedQpu = xacc::getAccelerator("quest", {std::make_pair("idle-qubit-compaction", false)});
+	uncompactedQpu->execute(xacc::qalloc(4), program);
+	ASSERT_EQ(uncompactedQpu->getExecutionInfo().get<int>("register-qubits"), 4);
+
+	// A configuration without the option is back to the default, compacting one
+	auto qpu = xacc::getAccelerator("quest");
+	qpu->execute(xacc::qalloc(4), program);
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("register-qubits"), 2);
+
+}
+
+TEST (gateTest, permutationOnTopQubit) {
+
+	// A permutation run, and the qubit map put back in place, moving amplitudes across the highest qubit
+	const std::string source = R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		Ry(q[1], 0.4);
+		Rx(q[2], 1.3);
+		U(q[3], 0.2, 0.9, -0.5);
+		H(q[4]);
+		Ry(q[5], -0.7);
+		X(q[5]);
+		CNOT(q[5], q[0]);
+		Swap(q[2], q[5]);
+		CNOT(q[1], q[5]);
+		X(q[0]);
+		Swap(q[5], q[3]);
+		CNOT(q[4], q[5]);
+		Rz(q[5], 0.6);
+		Ry(q[3], 0.8);
+	})";
+
+	for(const bool swapRelabeling : {false, true}){
+		auto qpu = compareWithReference({source}, 6,
+				{std::make_pair("gate-fusion", false), std::make_pair("permutation-composition", false), std::make_pair("swap-relabeling", false)},
+				{std::make_pair("gate-fusion", false), std::make_pair("swap-relabeling", swapRelabeling)});
+		ASSERT_GE(qpu->getExecutionInfo().get<int>("permutation-runs"), 1);
+	}
+
+}
+
+TEST (gateTest, windowAcrossBlockBoundary) {
+
+	// Blocks of 2^4 amplitudes: the window gates on qubits 0-3 are interleaved with gates straddling qubits 3 and 4
+	const std::string source = R"(__qpu__ void test(qbit q) {
+		H(q[0]);
+		H(q[1]);
+		H(q[2]);
+		H(q[3]);
+		H(q[4]);
+		CNOT(q[3], q[4]);
+		Ry(q[2], 0.5);
+		CPhase(q[4], q[3], 0.6);
+		CNOT(q[0], q[3]);
+		Swap(q[3], q[4]);
+		Rx(q[1], 0.2);
+		CZ(q[2], q[4]);
+		U(q[3], 0.3, -0.4, 0.9);
+		CNOT(q[4], q[8]);
+		Ry(q[6], 1.2);
+		CNOT(q[5], q[7]);
+		H(q[3]);
+		CNOT(q[3], q[0]);
+	})";
+
+	auto qpu = compareWithReference({source}, 9, {std::make_pair("cache-block-qubits", 0), std::make_pair("idle-qubit-compaction", false)},
+			{std::make_pair("cache-block-qubits", 4), std::make_pair("fusion-max-qubits", 1), std::make_pair("idle-qubit-compaction", false)});
+	ASSERT_GE(qpu->getExecutionInfo().get<int>("cache-windows"), 1);
+
+}
+
+TEST (gateTest, idleThenUsedQubits) {
+
+	// Qubits 0, 2 and 4 are idle in the first kernel and used by the second one, on the same buffer
+	const std::string first = R"(__qpu__ void first(qbit q) {
+		H(q[1]);
+		CNOT(q[1], q[3]);
+		Ry(q[3], 0.4);
+	})";
+	const std::string second = R"(__qpu__ void second(qbit q) {
+		H(q[0]);
+		Ry(q[2], 0.7);
+		CNOT(q[0], q[3]);
+		CNOT(q[2], q[1]);
+		Rx(q[4], -0.5);
+		CPhase(q[4], q[1], 0.3);
+	})";
+
+	// The first kernel again last, replayed with its own qubit map
+	auto qpu = compareWithReference({first, second, first}, 5, {std::make_pair("idle-qubit-compaction", false)}, {});
+	ASSERT_EQ(qpu->getExecutionInfo().get<int>("register-qubits"), 2);
+
+}
+
+TEST (gateTest, parametricRebinding) {
+
+	auto compiler = xacc::getCompiler("xasm");
+
+	// A diagonal run and fused blocks whose entries all depend on the variables
+	auto ir = compiler->compile(R"(__qpu__ void test(qbit q, double a, double b) {
+		H(q[0]);
+		H(q[1]);
+		H(q[2]);
+		Rz(q[0], a);
+		CPhase(q[0], q[1], b);
+		Rz(q[1], a - b);
+		CZ(q[1], q[2]);
+		Rx(q[0], b);
+		Ry(q[0], 2 * a);
+		CNOT(q[0], q[1]);
+		Ry(q[1], a + 0.5);
+		U(q[2], a, b, 0.3);
+		CNOT(q[2], q[0]);
+	})", xacc::getAccelerator("quest"));
+
+	auto program = ir->getComposite("test");
+
+	// The same kernel bound again and again, back to its first parameters last
+	for(const auto& parameters : std::vector<std::vector<double>>{{0.4, -1.2}, {2.1, 0.7}, {-0.3, 3.0}, {0.4, -1.2}}){
+
+		auto referenceQpu = xacc::getAccelerator("quest", {std::make_pair("gate-fusion", false), std::make_pair("diagonal-accumulation", false)});
+		auto referenceReg = xacc::qalloc(3);
+		referenceQpu->execute(referenceReg, (*program)(parameters));
+
+		std::vector<double> reference_real = referenceReg->getInformation("statevect_real").as<std::vector<double>>();
+		std::vector<double> reference_imag = referenceReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+		auto qpu = std::dynamic_pointer_cast<quacc::Quacc>(xacc::getAccelerator("quest"));
+		ASSERT_TRUE(qpu);
+		auto qubitReg = xacc::qalloc(3);
+		qpu->execute(qubitReg, program, parameters);
+
+		std::vector<double> statevect_real = qubitReg->getInformation("statevect_real").as<std::vector<double>>();
+		std::vector<double> statevect_imag = qubitReg->getInformation("statevect_imag").as<std::vector<double>>();
+
+		ASSERT_TRUE(stateVectorEq(statevect_real, statevect_imag, reference_real, reference_imag));
+
+	}
+
+}
+
 int main(int argc, char **argv) {
 
 	xacc::Initialize();
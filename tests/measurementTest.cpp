@@ -0,0 +1,152 @@
+/***********************************************************************************
+ * Copyright (c) 2021, Milos Prokop
+ *
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * Neither the name of the xacc nor the
+ *     names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ *AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ *IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL <COPYRIGHT HOLDER> BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ **********************************************************************************/
+
+#include <iostream>
+#include <gtest/gtest.h>
+#include "xacc.hpp"
+#include <cmath>
+
+TEST(measurementTest, shotSampling){
+
+	const int shots = 1000;
+
+	auto qubitReg = xacc::qalloc(3);
+	auto qpu = xacc::getAccelerator("quest", {std::make_pair("shots", shots)});
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void bell(qbit q) {
+		H(q[0]);
+		CNOT(q[0], q[2]);
+		Measure(q[0]);
+		Measure(q[2]);
+	})", qpu);
+
+	auto program = ir->getComposite("bell");
+
+	qpu->execute(qubitReg, program);
+
+	auto counts = qubitReg->getMeasurementCounts();
+
+	int total = 0;
+	for(auto &count: counts){
+		ASSERT_TRUE(count.first == "00" || count.first == "11");
+		total += count.second;
+	}
+
+	ASSERT_EQ(total, shots);
+	ASSERT_EQ(counts.size(), 2);
+
+	// <Z0 Z2> of the state the shots were drawn from
+	ASSERT_TRUE(qubitReg->hasExtraInfoKey("exp-val-z"));
+	ASSERT_NEAR(qubitReg->getInformation("exp-val-z").as<double>(), 1.0, 1e-6);
+
+}
+
+TEST(measurementTest, terminalMeasurements){
+
+	auto qubitReg = xacc::qalloc(3);
+	auto qpu = xacc::getAccelerator("quest");
+	auto compiler = xacc::getCompiler("xasm");
+
+	auto ir = compiler->compile(R"(__qpu__ void ghz(qbit q) {
+		H(q[0]);
+		CNOT(q[0], q[1]);
+		CNOT(q[1], q[2]);
+		Measure(q[0]);
+		Measure(q[1]);
+		Measure(q[2]);
+	})", qpu);
+
+	auto program = ir->getComposite("ghz");
+
+	qpu->execute(qubitReg, program);
+
+	// Parity of |000> + |111> over all three qubits
+	ASSERT_NEAR(qubitReg->getExpectationValueZ(), 0.0, 1e-9);
+
+	auto qubitReg2 = xacc::qalloc(2);
+
+	auto ir2 = compiler->compile(R"(__qpu__ void bell(qbit q) {
+		H(q[0]);
+		CNOT(q[0], q[1]);
+		Measure(q[0]);
+		Measure(q[1]);
+	})", qpu);
+
+	qpu->execute(qubitReg2, ir2->getComposite("bell"));
+
+	ASSERT_NEAR(qubitReg2->getExpectationValueZ(), 1.0, 1e-9);
+
+}
+
+TEST(measurementTest, lightCone){
+
+	auto referenceQpu = xacc::getAccelerator("quest");
+	auto compiler = xacc::getCompiler("xasm");
+
+	// The measured qubits only depend on the gates on q[0], q[1] and q[3] up to CNOT(q[1], q[3]),
+	// the others are left out of the simulation, and so are q[2], q[4] and q[5]
+	auto ir = compiler->compile(R"(__qpu__ void cone(qbit q) {
+		H(q[0]);
+		Ry(q[1], 0.7);
+		Rx(q[4], 1.3);
+		CNOT(q[4], q[5]);
+		CNOT(q[0], q[1]);
+		Ry(q[3], -0.4);
+		CNOT(q[1], q[3]);
+		CNOT(q[5], q[2]);
+		Rx(q[0], 0.9);
+		H(q[5]);
+		Measure(q[1]);
+		Measure(q[3]);
+	})", referenceQpu);
+
+	auto program = ir->getComposite("cone");
+
+	auto referenceReg = xacc::qalloc(6);
+	referenceQpu->execute(referenceReg, program);
+
+	auto qpu = xacc::getAccelerator("quest", {std::make_pair("light-cone", true)});
+	auto qubitReg = xacc::qalloc(6);
+	qpu->execute(qubitReg, program);
+
+	ASSERT_NEAR(qubitReg->getExpectationValueZ(), referenceReg->getExpectationValueZ(), 1e-9);
+
+}
+
+int main(int argc, char **argv) {
+
+	xacc::Initialize();
+
+	::testing::InitGoogleTest(&argc, argv);
+	auto ret = RUN_ALL_TESTS();
+	xacc::Finalize();
+	return ret;
+
+}